@@ -0,0 +1,153 @@
+/*********************************************************************************
+    (c) Copyright 2011-2016 Singular Computing LLC
+
+    This file and related materials are Confidential Information
+    and Proprietary Property of Singular Computing LLC.
+
+**********************************************************************************/
+
+
+/*
+
+  Throughput benchmark for converting whole matrices between float and
+  approx on the CPU (mm-cvtArrays.c), compared with converting one element
+  at a time the way copyBToCU and copyAFromCU used to.
+
+  It first checks that the bulk conversions give exactly the same bits as
+  cvtApprox and cvtFloat, then times both ways of converting.
+
+  To run:  ./cvtBenchmark [<elements>]
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "scAcceleratorAPI.h"
+#include "scNova.h"
+
+#include "mm-seconds.c"
+
+#include "mm-cvtArrays.c"
+
+int main (int argc, char *argv[]) {
+    // The number of elements to convert in each timed pass.
+    int n = 1<<20;
+    int repeats = 10;
+    int i, r;
+    int errors = 0;
+
+    if (argc > 2) {
+        printf("  Command line arguments are:\n");
+        printf("  [<elements>]  number of elements to convert (default %d)\n",
+               n);
+        exit(1);
+    }
+    if (argc > 1) n = atoi(argv[1]);
+    if (n <= 0) {
+        printf("The number of elements must be at least 1.\n");
+        exit(1);
+    }
+
+    initSingularArithmetic ();
+    initCvtArrays ();
+
+    float *floats = calloc(n, sizeof(float));
+    float *floatsOut = malloc(sizeof(float)*n);
+    scApprox *approxes = calloc(n, sizeof(scApprox));
+    scApprox *approxesOut = malloc(sizeof(scApprox)*n);
+    if (floats == NULL || floatsOut == NULL || approxes == NULL ||
+        approxesOut == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+
+    // Every approx value must convert to the same float both ways.
+    for (i = 0; i < (1<<16); i++) {
+        scApprox a = (scApprox)i;
+        float f, g = cvtFloat(a);
+        cvtFloatArray(&f, &a, 1);
+        if (memcmp(&f, &g, sizeof(float)) != 0) {
+            errors++;
+        }
+    }
+
+    // Every float at the edges of a floatToApprox entry, and one in the
+    // middle, must convert the same both ways.
+    int b;
+    for (b = 0; b < (1<<16); b++) {
+        uint32_t bits[3] = { (uint32_t)b << 16, ((uint32_t)b << 16) | 0x8000,
+                             ((uint32_t)b << 16) | 0xFFFF };
+        float f[3];
+        scApprox a[3];
+        memcpy(f, bits, sizeof(f));
+        cvtApproxArray(a, f, 3);
+        for (i = 0; i < 3; i++) {
+            if (a[i] != cvtApprox(f[i])) errors++;
+        }
+    }
+
+    // A spread of float values, positive and negative, large and small.
+    srand(1);
+    for (i = 0; i < n; i++) {
+        floats[i] = ldexpf((float)rand()/RAND_MAX, rand()%40 - 20) *
+                    (rand()%2 ? 1 : -1);
+        approxes[i] = cvtApprox(floats[i]);
+    }
+
+    // The bulk conversions must match the scalar ones bit for bit.
+    cvtApproxArray(approxesOut, floats, n);
+    cvtFloatArray(floatsOut, approxes, n);
+    for (i = 0; i < n; i++) {
+        float f = cvtFloat(approxes[i]);
+        if (approxesOut[i] != approxes[i] ||
+            memcmp(&floatsOut[i], &f, sizeof(float)) != 0) {
+            errors++;
+        }
+    }
+    if (errors) {
+        printf("Bulk conversion differs from scalar conversion in %d places.\n",
+               errors);
+        exit(1);
+    }
+
+    // Time each way of converting, repeats times over n elements.
+    double start, scalarToApprox, bulkToApprox, scalarToFloat, bulkToFloat;
+
+    start = wallSeconds();
+    for (r = 0; r < repeats; r++) {
+        for (i = 0; i < n; i++) approxesOut[i] = cvtApprox(floats[i]);
+    }
+    scalarToApprox = wallSeconds() - start;
+
+    start = wallSeconds();
+    for (r = 0; r < repeats; r++) cvtApproxArray(approxesOut, floats, n);
+    bulkToApprox = wallSeconds() - start;
+
+    start = wallSeconds();
+    for (r = 0; r < repeats; r++) {
+        for (i = 0; i < n; i++) floatsOut[i] = cvtFloat(approxes[i]);
+    }
+    scalarToFloat = wallSeconds() - start;
+
+    start = wallSeconds();
+    for (r = 0; r < repeats; r++) cvtFloatArray(floatsOut, approxes, n);
+    bulkToFloat = wallSeconds() - start;
+
+    double elements = (double)n*repeats;
+    printf("conversion,method,Melements_per_second\n");
+    printf("float_to_approx,scalar,%.1f\n", elements/scalarToApprox/1e6);
+    printf("float_to_approx,bulk,%.1f\n", elements/bulkToApprox/1e6);
+    printf("approx_to_float,scalar,%.1f\n", elements/scalarToFloat/1e6);
+    printf("approx_to_float,bulk,%.1f\n", elements/bulkToFloat/1e6);
+
+    free(floats);
+    free(floatsOut);
+    free(approxes);
+    free(approxesOut);
+    return 0;
+}
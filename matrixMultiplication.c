@@ -21,6 +21,14 @@
   For this code, A and B have fixed, identical, square NxN shapes, where N=8.
   Matrix elements are stored one per core.
 
+  We also multiply larger matrices, of any shape, by splitting them into
+  NxN tiles and accumulating the tile products in the S1 (see
+  emitTiledMatrixMul).
+
+  The NxN grid of apes can be spread over several chips, by giving a chip
+  count on the command line, e.g. "./matrixMultiplication emulated 0 2"
+  emulates 2x2 chips of 4x4 apes each.
+
 */
 
 
@@ -57,8 +65,48 @@ int apeCols;
 
 int traceFlags;
 
-// Define the length of the square matrices.
+// 1 to start each torus shift in the main loop of emitMatrixMul before
+// the arithmetic, 0 to shift after the arithmetic is done.  Either way
+// every get has its full torusGetMoves moves, so the two emit the same
+// instructions in a different order, and the overlap gains only if the
+// network moves the word during the arithmetic.  It also relies on the
+// arithmetic leaving the registers the get is using alone, which the Nova
+// translator does not promise.  So it is off until the
+// skew_multiply_loop_pipelined phase of the benchmark shows it is worth
+// it.
+int pipelineCannonLoop = 0;
+
+// How the copies between CU memory and the apes are looped.  0 unrolls
+// every column of the grid into an instruction of its own.  Any other
+// value puts every loop in a CUFor, with copyUnroll columns per trip of
+// the innermost one, so the copies take the same instruction memory
+// whatever the size of the grid.  See emitCopyLoops.
+int copyUnroll = 0;
+
+// The number of instructions the matrix copies have emitted, counted as
+// they are emitted, so the benchmark can report what each copyUnroll
+// costs in instruction memory.  CUFor and CUForEnd count as one each,
+// since the CU rereads a loop's instructions rather than repeating them,
+// though Nova may add a few of its own to set up and test the register.
+// eControl only tells the translator which registers are in use, so it
+// does not count.
+int copyInstructions = 0;
+
+// The delay, in cycles, each cuRead in emitCopyMatrixFromApesToCU allows
+// for the word to arrive from the ape before the next instruction.  Too
+// short and the CU gets the wrong word; too long and every copy to the CU
+// is slower than it needs to be.  4 is a guess that is plenty long on one
+// chip.  calibratePropDelay measures the right value for the machine and
+// grid, which may need longer reads across chips, trying every delay up
+// to MAX_PROP_DELAY.
+int propDelay = 4;
+#define MAX_PROP_DELAY 15
+
+// Define the length of the square matrices.  The benchmark builds
+// override this with -DN=<length> to sweep matrix sizes.
+#ifndef N
 #define N 8
+#endif
 
 // Declare space for matrices A and B on the CPU, in float format.
 float floatA[N][N];
@@ -68,6 +116,34 @@ float floatB[N][N];
 // aligned at 64 bits.
 uint64_t approxM[(N*N)/4];
 
+// The approx words of the resident matrix (Aresident) as last copied to
+// the CU, so that copyDirtyRowsToCU can copy just the rows that change.
+uint64_t approxResident[(N*N)/4];
+
+// Dimensions of the tiled multiply:  C (tiledM x tiledP) =
+// A (tiledM x tiledK) * B (tiledK x tiledP).  These can be any size that
+// fits in CPU memory, since the tiles are streamed through CU Data Memory
+// a pair at a time.
+int tiledM;
+int tiledK;
+int tiledP;
+
+// Declare space for the tiled matrices on the CPU, in float format, in
+// row major order.  These are allocated once the dimensions are known.
+float *floatTA;
+float *floatTB;
+float *floatTC;
+
+// Declare space on the CPU for the next pair of tiles of the tiled
+// multiply, a tile of A followed by a tile of B, in approx format
+// (16 bits), aligned at 64 bits.
+uint64_t approxTiles[(2*N*N)/4];
+
+int numTiles (int n) {
+    // Returns the number of NxN tiles needed to cover n rows or columns.
+    return (n + N - 1) / N;
+}
+
 // Declare often used Nova Constants.
 Declare(a0);
 Declare(a1);
@@ -76,33 +152,185 @@ Declare(a1);
 Declare(A);
 Declare(B);
 
+// Declare the name of the running sum of tile products in Ape memory.
+Declare(C);
+
+// The most matrix multiplies emitMatrixMulBatch can do at once.
+#define MAX_BATCH 16
+
+// Declare names of batchCount pairs of matrices in Ape memory, for
+// batched multiplies:  batchA[k] = batchA[k] * batchB[k].  Each array is
+// allocated in consecutive Ape memory words.
+int batchCount = MAX_BATCH;
+scExpr batchA[MAX_BATCH];
+scExpr batchB[MAX_BATCH];
+
+// Declare the name of the resident matrix that a stream of B matrices is
+// multiplied by, in Ape memory.
+Declare(Aresident);
+
+// Declare names of the vectors x and y in y = M * x, in Ape memory.
+// emitMatrixVectorMul copies x into the top row, and leaves y in the
+// left column.
+Declare(X);
+Declare(Y);
+
+// Declare names, in Ape memory, for the result of a reduction over the
+// whole grid and, for an argmax, its row and column number.  Only ape
+// [0, 0] is used, to copy them to the CU.
+Declare(reduceValue);
+Declare(reduceRow);
+Declare(reduceCol);
+
+// Declare the name, in Ape memory, of the word a kernel posts to the
+// mailbox to say a result is ready.
+Declare(mailboxWord);
+
+// Declare names, in CU Data Memory, for the list of rows that
+// copyDirtyRowsToCU has changed:  how many there are, and the chip row
+// and ape row of each, in order.  The kernel reads them when it runs, so
+// one emitted copy serves whatever rows change.  Each array is allocated
+// in consecutive CU memory words.  The kernel walks a copy of the list,
+// in dirtyChipWalk and dirtyApeWalk, so the list itself is still there
+// if the kernel copies the same rows again.
+Declare(dirtyRowCount);
+scExpr dirtyChipRow[N];
+scExpr dirtyApeRow[N];
+scExpr dirtyChipWalk[N];
+scExpr dirtyApeWalk[N];
+
+// Declare names, in Ape memory, of each ape's row and column number in
+// the ape grid, and of masks that are 1 in the apes on the diagonal and
+// on each edge of the grid (and 0 elsewhere).  These are computed once,
+// by emitApeCoordinates, and reused by every kernel.
+Declare(apeRowNum);
+Declare(apeColNum);
+Declare(onDiagonal);
+Declare(onTopRow);
+Declare(onBottomRow);
+Declare(onLeftCol);
+Declare(onRightCol);
+
+#include "mm-apePool.c"
+
+#include "mm-emitApeCoordinates.c"
+
 void defineNames () {
 // Initialization routine to define the names above.
     a0 = AConst(0);
     a1 = AConst(1);
     ApeMem(A, Approx);
     ApeMem(B, Approx);
+    ApeMem(C, Approx);
+    ApeMem(Aresident, Approx);
+    ApeMem(X, Approx);
+    ApeMem(Y, Approx);
+    ApeMem(reduceValue, Approx);
+    ApeMem(reduceRow, Int);
+    ApeMem(reduceCol, Int);
+    ApeMem(mailboxWord, Int);
+    CUMem(dirtyRowCount, Int);
+    int k;
+    for (k = 0; k < N; k++) {
+        CUMem(dirtyChipRow[k], Int);
+    }
+    for (k = 0; k < N; k++) {
+        CUMem(dirtyApeRow[k], Int);
+    }
+    for (k = 0; k < N; k++) {
+        CUMem(dirtyChipWalk[k], Int);
+    }
+    for (k = 0; k < N; k++) {
+        CUMem(dirtyApeWalk[k], Int);
+    }
+    for (k = 0; k < batchCount; k++) {
+        ApeMem(batchA[k], Approx);
+    }
+    for (k = 0; k < batchCount; k++) {
+        ApeMem(batchB[k], Approx);
+    }
+    ApeMem(apeRowNum, Int);
+    ApeMem(apeColNum, Int);
+    ApeMem(onDiagonal, Int);
+    ApeMem(onTopRow, Int);
+    ApeMem(onBottomRow, Int);
+    ApeMem(onLeftCol, Int);
+    ApeMem(onRightCol, Int);
+
+    // A new machine starts with no temporaries.
+    apePoolReset();
+
+    // Fill in the coordinates once, at the start of the first kernel.
+    emitApeCoordinates();
 }
 
+#include "mm-seconds.c"
+
+#include "mm-cvtArrays.c"
+
+#include "mm-profile.c"
+
+#include "mm-emitCopyLoops.c"
+
 #include "mm-emitCopyMatrixFromCUToApes.c"
 
 #include "mm-emitCopyMatrixFromApesToCU.c"
 
-#include "mm-copyBFromCU.c"
+#include "mm-calibratePropDelay.c"
+
+#include "mm-copyBToCU.c"
 
 #include "mm-copyAFromCU.c"
 
+#include "mm-copyDirtyRowsToCU.c"
+
+#include "mm-emitCopyRowsFromCUToApes.c"
+
 void emitMatrixSet () {
     Set(A, B);
 }
 
 #include "mm-emitGetTorus.c"
 
+#include "mm-emitMatrixMulLean.c"
+
 #include "mm-emitMatrixMul.c"
 
+#include "mm-cvtTile.c"
+
+#include "mm-copyTileFromCU.c"
+
+#include "mm-emitTiledMatrixMul.c"
+
+#include "mm-emitStreamMatrixMul.c"
+
+#include "mm-emitCopyColumnFromApesToCU.c"
+
+#include "mm-emitReduce.c"
+
+#include "mm-emitMatrixVectorMul.c"
+
+#include "mm-emitMatrixPower.c"
+
+#include "mm-mailbox.c"
+
+
+#include "mm-hostMatrixMul.c"
+
+#include "mm-machine.c"
 
 #include "mm-check.c"
 
+// Built with -DBENCHMARK, the program times the phases of the matrix
+// multiply instead of running the tests.
+#ifdef BENCHMARK
+
+#include "mm-benchmark.c"
+
+#else
+
 #include "mm-tests.c"
 
 #include "mm-main.c"
+
+#endif
@@ -0,0 +1,106 @@
+// A pool of ape variables for the temporaries of the emitters.
+//
+// Each DeclareApeVar makes a new ape variable every time it is emitted,
+// and nothing gives it back, so a kernel that multiplies many times, as
+// emitMatrixPower and the batched and streamed multiplies do, soon runs
+// out of ape memory.  So the emitters take their temporaries from this
+// pool instead.  apeScopeBegin returns a mark, apeTemp hands out a free
+// variable of a type, making a new one only if none is free, and
+// apeScopeEnd gives back every variable taken since the mark, for the
+// next emitter to reuse.  Scopes nest like the calls that open them.
+//
+// A variable keeps its storage from one kernel to the next, so a scope
+// may span kernels, as the phases of the benchmark do.  Nothing is kept
+// from one machine to the next:  defineNames empties the pool.
+//
+// apePoolHighWater is the most variables ever in use at once, and
+// apePoolCount how many the pool has made, which is the ape memory the
+// temporaries take.  They differ only when the types in use change.
+
+// The most temporaries any emitter takes is the five per multiply, and
+// two shift counts, of emitMatrixMulStart with a full batch.  The rest
+// leaves room for emitters that run while those are taken, such as the
+// copy of P in emitMatrixPower, and the six of a reduction.
+#define MAX_APE_POOL (5*MAX_BATCH + 2 + 16)
+
+typedef struct {
+    scExpr var;
+    int type;     // Int or Approx.
+    int inUse;
+} ApePoolVar;
+ApePoolVar apePool[MAX_APE_POOL];
+int apePoolCount = 0;
+
+// The variables in use, in the order they were taken, so apeScopeEnd can
+// give back the newest first.
+int apePoolTaken[MAX_APE_POOL];
+int apePoolInUse = 0;
+int apePoolHighWater = 0;
+
+void apePoolReset () {
+    // Forgets every variable in the pool, for a new machine.
+    apePoolCount = 0;
+    apePoolInUse = 0;
+    apePoolHighWater = 0;
+}
+
+int apeScopeBegin () {
+    // Opens a scope for temporaries, and returns its mark for apeScopeEnd.
+    return apePoolInUse;
+}
+
+scExpr apeTemp (int type) {
+    // Returns an ape variable of type Int or Approx that nothing else is
+    // using, until the scope it is taken in ends.
+    int k;
+    for (k = 0; k < apePoolCount; k++) {
+        if (!apePool[k].inUse && apePool[k].type == type) break;
+    }
+    if (k == apePoolCount) {
+        if (k == MAX_APE_POOL) {
+            printf("More than %d ape temporaries.\n", MAX_APE_POOL);
+            exit(1);
+        }
+        if (type == Int) {
+            DeclareApeVar(t, Int);
+            apePool[k].var = t;
+        } else {
+            DeclareApeVar(t, Approx);
+            apePool[k].var = t;
+        }
+        apePool[k].type = type;
+        apePoolCount++;
+    }
+    apePool[k].inUse = 1;
+    apePoolTaken[apePoolInUse++] = k;
+    if (apePoolInUse > apePoolHighWater) apePoolHighWater = apePoolInUse;
+    return apePool[k].var;
+}
+
+int apePoolMeasureBegin () {
+    // Starts measuring how many temporaries the code emitted from here on
+    // takes at once.  Returns the high-water mark so far, for
+    // apePoolMeasureEnd to put back.
+    int highWater = apePoolHighWater;
+    apePoolHighWater = apePoolInUse;
+    return highWater;
+}
+
+int apePoolMeasureEnd (int highWater) {
+    // Returns the most temporaries taken at once since apePoolMeasureBegin
+    // returned highWater, once every scope opened since then has ended.
+    int taken = apePoolHighWater - apePoolInUse;
+    if (highWater > apePoolHighWater) apePoolHighWater = highWater;
+    return taken;
+}
+
+void apeScopeEnd (int mark) {
+    // Gives back every temporary taken since apeScopeBegin returned mark.
+    if (mark > apePoolInUse) {
+        printf("apeScopeEnd for a scope that has already ended.\n");
+        exit(1);
+    }
+    while (apePoolInUse > mark) {
+        apePool[apePoolTaken[--apePoolInUse]].inUse = 0;
+    }
+}
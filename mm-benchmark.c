@@ -0,0 +1,206 @@
+void benchRunKernel (char *phase, int instructions, int apeWords) {
+    // Ends the kernel being emitted, runs it to completion, and prints a
+    // CSV line with the cycles it took (on the emulator) and the wall time
+    // the CPU spent on it.  Then starts emitting a new kernel.
+    // If phase is NULL, the kernel is setup work and nothing is printed.
+    // instructions is the number of instructions the phase emitted, and
+    // apeWords the number of ape memory words it worked in, beyond its
+    // operands.  Either may be 0 if it was not counted, which leaves that
+    // column empty.
+
+    // Send signal to CPU when done, then halt.
+    emitSignalCPU();
+    eCUC(cuHalt, _, _, _);
+
+    double start = wallSeconds();
+
+    // Emit the low level translation, then load, free, and start it.
+    ellNewKernelInstructions();
+    scLLKernelLoad (llKernel, 0);
+    scLLKernelFree(llKernel);
+    scLLKernelExecute(0);
+
+    // Wait for the kernel to finish.
+    waitSignalCPU();
+    scClearCUSignal();
+    waitHalt(phase != NULL ? phase : "Benchmark");
+
+    double seconds = wallSeconds() - start;
+
+    if (phase != NULL) {
+        printf("%d,%d,%d,%d,%d,%s,%d,%.6f,",
+               N, chipRows, chipCols, apeRows, apeCols, phase,
+               emulated ? scTotalCyclesTaken : 0, seconds);
+        if (instructions != 0) printf("%d", instructions);
+        printf(",");
+        if (apeWords != 0) printf("%d", apeWords);
+        printf("\n");
+    }
+
+    // Start the next kernel.
+    scEmitLLKernelCreate();
+}
+
+void benchmark (Machine *m) {
+    // Times each phase of an NxN matrix multiply on the machine m, which
+    // runMachines has started, and prints one CSV line per phase:
+    //   N,chipRows,chipCols,apeRows,apeCols,phase,cycles,seconds,
+    //   instructions,ape_words
+    // Each phase of the multiply runs as a kernel of its own, so that
+    // scTotalCyclesTaken counts just that phase.
+    int i, j, u;
+    (void)m;
+
+    // Host conversion:  convert B to approx and A back to float, the way
+    // copyBToCU and copyAFromCU do, and time it on the CPU.
+    for (i=0; i<N; i++) {
+        for (j=0; j<N; j++) {
+            floatB[i][j] = 1 + (i+j)%4;
+        }
+    }
+    double start = wallSeconds();
+    cvtApproxArray((scApprox *)approxM, &floatB[0][0], N*N);
+    cvtFloatArray(&floatA[0][0], (scApprox *)approxM, N*N);
+    printf("%d,%d,%d,%d,%d,%s,%d,%.6f,,\n",
+           N, chipRows, chipCols, apeRows, apeCols, "host_conversion",
+           0, wallSeconds() - start);
+    scWriteCUDataMemoryBlock(2*N*N, (uintptr_t)approxM, 0);
+
+    // Copy in:  copy B from the CU to the apes, and make A the same.
+    int counted = copyInstructions;
+    emitCopyMatrixFromCUToApes(0 /* cuAddress */, MemAddress(B));
+    int instructions = copyInstructions - counted;
+    emitMatrixSet();
+    benchRunKernel("copy_in", instructions, 0);
+
+    // Skew A and B.
+    scExpr As[1];
+    scExpr Bs[1];
+    As[0] = A;
+    Bs[0] = B;
+    MatrixMulVars v;
+    int highWater = apePoolMeasureBegin();
+    emitMatrixMulStart(&v, As, Bs, 1);
+    emitMatrixMulSkew(&v);
+    benchRunKernel("skew", 0, 0);
+
+    // The main loop, and putting the product in A.
+    emitMatrixMulLoop(&v);
+    emitMatrixMulEnd(&v);
+    benchRunKernel("multiply_loop", 0, apePoolMeasureEnd(highWater));
+
+    // The same multiply, using as little ape memory as it can.  A is now
+    // A * B, and B is as it was, so this makes A = A * B * B.
+    highWater = apePoolMeasureBegin();
+    emitMatrixMulLean(As, Bs, 1, 1);
+    benchRunKernel("multiply_lean", 0, apePoolMeasureEnd(highWater));
+
+    // The main loop again with the torus shifts overlapped with the
+    // arithmetic, to compare with multiply_loop.  The skew goes in the
+    // same kernel, since the loop needs the variables it sets up; take
+    // the skew's cycles off to compare.
+    pipelineCannonLoop = 1;
+    emitMatrixMulStart(&v, As, Bs, 1);
+    emitMatrixMulSkew(&v);
+    emitMatrixMulLoop(&v);
+    emitMatrixMulEnd(&v);
+    benchRunKernel("skew_multiply_loop_pipelined", 0, 0);
+    pipelineCannonLoop = 0;
+
+    // Copy out:  copy A from the apes to the CU.
+    counted = copyInstructions;
+    emitCopyMatrixFromApesToCU(MemAddress(A), 0 /* cuAddress */);
+    benchRunKernel("copy_out", copyInstructions - counted, 0);
+
+    // y = A * x, with x the first row of B in CU memory, for comparison
+    // with the whole multiply.
+    emitMatrixVectorMul(A, 0 /* cuAddressX */, N*N /* cuAddressY */);
+    benchRunKernel("matrix_vector", 0, 0);
+
+    // The copies again with compact CUFor loops, for each unroll factor
+    // up to the width of a chip, to weigh the instruction memory they take
+    // against the cycles their loop tests cost.
+    char phase[100];
+    for (u = 1; u <= apeCols; u *= 2) {
+        copyUnroll = u;
+        sprintf(phase, "copy_in_unroll_%d", u);
+        counted = copyInstructions;
+        emitCopyMatrixFromCUToApes(0 /* cuAddress */, MemAddress(B));
+        benchRunKernel(phase, copyInstructions - counted, 0);
+        sprintf(phase, "copy_out_unroll_%d", u);
+        counted = copyInstructions;
+        emitCopyMatrixFromApesToCU(MemAddress(A), 0 /* cuAddress */);
+        benchRunKernel(phase, copyInstructions - counted, 0);
+    }
+    copyUnroll = 0;
+
+    // The whole multiply again, as one kernel with profile marks around
+    // each phase.  The marks' own handshakes are counted too, and an empty
+    // region measures what they cost.  If scTotalCyclesTaken only moves
+    // when a kernel halts, the cycles column is left empty, and the
+    // separate kernels above give the cycles of each phase.
+    profiling = 1;
+    ProfileBegin("marks_only");
+    ProfileEnd();
+    ProfileBegin("copy_in");
+    emitCopyMatrixFromCUToApes(0 /* cuAddress */, MemAddress(B));
+    emitMatrixSet();
+    ProfileEnd();
+    emitMatrixMul();
+    ProfileBegin("copy_out");
+    emitCopyMatrixFromApesToCU(MemAddress(A), 0 /* cuAddress */);
+    ProfileEnd();
+    benchRunKernel(NULL, 0, 0);
+    profileFinish();
+    char prefix[100];
+    sprintf(prefix, "%d,%d,%d,%d,%d,profile_", N, chipRows, chipCols,
+            apeRows, apeCols);
+    profileReport(prefix);
+    profileReset();
+    profiling = 0;
+
+    // The most ape temporaries in use at once, over all the kernels above,
+    // and how many the pool made to supply them.
+    printf("%d,%d,%d,%d,%d,%s,,,,%d\n",
+           N, chipRows, chipCols, apeRows, apeCols, "ape_pool_high_water",
+           apePoolHighWater);
+    printf("%d,%d,%d,%d,%d,%s,,,,%d\n",
+           N, chipRows, chipCols, apeRows, apeCols, "ape_pool_count",
+           apePoolCount);
+}
+
+int main (int argc, char *argv[]) {
+    // Command line arguments are:
+    //   <machine>  'real' or 'emulated'
+    //   [<jobs>]   emulated machines to run at once (default: one per core)
+    // Prints CSV lines for every chip count that divides N into grids of at
+    // least 2x2 apes.  The header line is printed by the Makefile, so the
+    // output of several sizes can be concatenated.
+    if (argc < 2 || argc > 3 ||
+        (strcmp(argv[1], "real") != 0 && strcmp(argv[1], "emulated") != 0)) {
+        printf("  Command line arguments are:\n");
+        printf("  <machine>  'real' or 'emulated'\n");
+        printf("  [<jobs>]   emulated machines to run at once\n");
+        exit(1);
+    }
+    int jobs = argc == 3 ? atoi(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+
+    initSingularArithmetic ();
+    initCvtArrays ();
+
+    // One machine for each chip count.
+    Machine machines[N];
+    int count = 0;
+    int chips;
+    for (chips = 1; N/chips >= 2; chips *= 2) {
+        if (N % chips != 0) continue;
+        machines[count].emulated = strcmp(argv[1], "emulated") == 0;
+        machines[count].chipRows = chips;
+        machines[count].chipCols = chips;
+        machines[count].apeRows = N / chips;
+        machines[count].apeCols = N / chips;
+        machines[count].traceFlags = 0;
+        count++;
+    }
+    return runMachines(machines, count, jobs, benchmark) != 0;
+}
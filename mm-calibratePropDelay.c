@@ -0,0 +1,65 @@
+int calibratePropDelay () {
+    // Measures the smallest propDelay with which emitCopyMatrixFromApesToCU
+    // reads every ape correctly, on the machine and grid geometry just
+    // initialized, sets propDelay to it, and returns it.
+    // This runs a kernel of its own, so call it between kernels, once
+    // scEmitLLKernelCreate and defineNames have been called.  It destroys
+    // B in the apes and CU Data Memory from 0 to (MAX_PROP_DELAY+2)*N*N-1.
+    uint16_t *words = (uint16_t *)approxM;
+    int i, delay;
+
+    // A cuRead that has not had long enough to finish leaves behind the
+    // word read before it, or whatever was in CU memory already.  So give
+    // every ape a different, nonzero word, and read the whole grid back
+    // once for each delay, into CU memory that starts out as zeros.
+    emitCopyMatrixFromCUToApes(0 /* cuAddress */, MemAddress(B));
+    for (delay=0; delay<=MAX_PROP_DELAY; delay++) {
+        propDelay = delay;
+        emitCopyMatrixFromApesToCU(MemAddress(B), (delay+1)*N*N);
+    }
+    emitSignalCPU();
+    eCUC(cuHalt, _, _, _);
+    ellNewKernelInstructions();
+
+    for (i=0; i<N*N; i++) {
+        words[i] = 0;
+    }
+    for (delay=0; delay<=MAX_PROP_DELAY; delay++) {
+        scWriteCUDataMemoryBlock(2*N*N, (uintptr_t)approxM, (delay+1)*N*N);
+    }
+    for (i=0; i<N*N; i++) {
+        words[i] = i + 1;
+    }
+    scWriteCUDataMemoryBlock(2*N*N, (uintptr_t)approxM, 0);
+
+    // Load, free, and start the kernel, and wait for it to finish.
+    scLLKernelLoad (llKernel, 0);
+    scLLKernelFree(llKernel);
+    scLLKernelExecute(0);
+    scClearCUSignal();
+    waitSignalCPU();
+    scClearCUSignal();
+    waitHalt("Calibrate propDelay");
+    scEmitLLKernelCreate();
+
+    // A delay is safe if it, and every longer one, read the grid back
+    // exactly.  Requiring the longer ones too means a delay that happens
+    // to work after one that failed is not trusted.
+    int calibrated = -1;
+    for (delay=MAX_PROP_DELAY; delay>=0; delay--) {
+        scReadCUDataMemoryBlock(2*N*N, (uintptr_t)approxM, (delay+1)*N*N);
+        for (i=0; i<N*N; i++) {
+            if (words[i] != i + 1) break;
+        }
+        if (i < N*N) break;
+        calibrated = delay;
+    }
+    if (calibrated < 0) {
+        printf("No propDelay up to %d reads the apes correctly.\n",
+               MAX_PROP_DELAY);
+        exit(1);
+    }
+
+    propDelay = calibrated;
+    return calibrated;
+} // End calibratePropDelay.
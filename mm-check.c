@@ -1,10 +1,116 @@
-void check (char *testname, int i, int j, float expected) {
-    // Print an error if floatA[i][j] is not close to expected.
+void checkValue (char *testname, int i, int j, float actual, float expected) {
+    // Print an error if actual, the [i][j] element of a result, is not
+    // close to expected.
     // If expected is 0 then we need to not divide by 0.
-    float error = fabs((floatA[i][j] - expected) /
+    float error = fabs((actual - expected) /
                        (expected != 0 ? expected : 1e-15));
     if (error > .02) {
         printf("On test '%s', A[%0d][%0d]=%e but expected %e\n",
-               testname, i, j, floatA[i][j], expected);
+               testname, i, j, actual, expected);
+    }
+}
+
+void checkInt (char *testname, int actual, int expected) {
+    // Print an error if actual, a count or an index, is not exactly
+    // expected.
+    if (actual != expected) {
+        printf("On test '%s', got %d but expected %d\n",
+               testname, actual, expected);
+    }
+}
+
+void check (char *testname, int i, int j, float expected) {
+    // Print an error if floatA[i][j] is not close to expected.
+    checkValue(testname, i, j, floatA[i][j], expected);
+}
+
+// The relative error of a single approx operation.  Approx numbers keep
+// about 7 bits of precision, so each product or sum can be off by up to
+// about 1%.
+#define APPROX_EPSILON 0.01
+
+// How far a matrix result is from the correct result.  Errors are
+// measured relative to |row i of a| * |column j of b|, which bounds the
+// size of the terms summed into element [i][j], so they mean the same
+// thing for large and small elements, and don't blow up when the correct
+// result happens to be near zero.
+typedef struct {
+    double maxError;
+    double meanError;
+    int failures;      // Number of elements past the error bound.
+} MatrixError;
+
+MatrixError checkMatrix (char *testname, const float *actual,
+                         const float *a, const float *b,
+                         int m, int k, int p) {
+    // Checks actual, an m x p result, against a * b, where a is m x k and
+    // b is k x p, all in row major order.  The correct result is computed
+    // with hostMatrixMul.  Prints the first few elements that are past the
+    // error bound, and the largest and mean error, whether or not any are
+    // past it.
+    //
+    // The bound allows APPROX_EPSILON for each product, and grows with
+    // sqrt(k) for the sum, since the rounding errors of the k additions are
+    // as likely to cancel as to add up.
+    MatrixError result = { 0, 0, 0 };
+    double bound = APPROX_EPSILON * (2 + sqrt(k));
+    float *correct = malloc(sizeof(float)*m*p);
+    double *rowNorm = malloc(sizeof(double)*m);
+    double *colNorm = malloc(sizeof(double)*p);
+    int i, j;
+
+    if (correct == NULL || rowNorm == NULL || colNorm == NULL) {
+        printf("Out of memory checking test '%s'.\n", testname);
+        exit(1);
+    }
+
+    hostMatrixMul(a, b, correct, m, k, p);
+
+    for (i = 0; i < m; i++) rowNorm[i] = 0;
+    for (j = 0; j < p; j++) colNorm[j] = 0;
+    for (i = 0; i < m; i++) {
+        for (j = 0; j < k; j++) {
+            rowNorm[i] += (double)a[(size_t)i*k+j] * a[(size_t)i*k+j];
+        }
+    }
+    for (i = 0; i < k; i++) {
+        for (j = 0; j < p; j++) {
+            colNorm[j] += (double)b[(size_t)i*p+j] * b[(size_t)i*p+j];
+        }
+    }
+
+    double total = 0;
+    for (i = 0; i < m; i++) {
+        for (j = 0; j < p; j++) {
+            double scale = sqrt(rowNorm[i] * colNorm[j]);
+            double diff = fabs(actual[(size_t)i*p+j] - correct[(size_t)i*p+j]);
+            double error = scale != 0 ? diff / scale : diff;
+            total += error;
+            if (error > result.maxError) result.maxError = error;
+            if (error > bound) {
+                if (result.failures < 10) {
+                    printf("On test '%s', A[%0d][%0d]=%e but expected %e\n",
+                           testname, i, j, actual[(size_t)i*p+j],
+                           correct[(size_t)i*p+j]);
+                }
+                result.failures++;
+            }
+        }
+    }
+    result.meanError = total / ((double)m*p);
+
+    if (result.failures) {
+        printf("On test '%s', %d of %d elements past error bound %e"
+               " (max error %e, mean error %e)\n",
+               testname, result.failures, m*p, bound, result.maxError,
+               result.meanError);
+    } else {
+        printf("Test '%s':  max error %e, mean error %e, bound %e\n",
+               testname, result.maxError, result.meanError, bound);
     }
+
+    free(correct);
+    free(rowNorm);
+    free(colNorm);
+    return result;
 }
@@ -1,18 +1,14 @@
-void copyAFromCU () {
+void copyAFromCU (int cuAddress) {
     // Copies matrix A in CU Data Memory to matrix A (floatA) in CPU
     // (and converts the values from approx to float).
 
-    // First, copies CUDataMem[0..N*N-1] to approxM[N][N] matrix, in row
-    // major order.
-    scReadCUDataMemoryBlock(2*N*N, (uintptr_t)approxM, 0 /* CU Data Memory 
-                                                         starting address */);
+    // First, copies CUDataMem[cuAddress..cuAddress+N*N-1] to approxM[N][N]
+    // matrix, in row major order.
+    scReadCUDataMemoryBlock(2*N*N, (uintptr_t)approxM, cuAddress);
 
-    // Next, converts each value in approxM to floatA in the CPU.
-    int row, col;
-    for (row=0; row<N; row++) {
-        for (col=0; col<N; col++) {
-            floatA[row][col] = cvtFloat(((scApprox *)approxM)[N*row+col]);
-        }
-    }
+    // Next, converts all the values in approxM to floatA in the CPU at
+    // once.  floatA is stored in row major order too, so it is one flat
+    // array of N*N values.
+    cvtFloatArray(&floatA[0][0], (scApprox *)approxM, N*N);
 
 } // End copyAFromCU.
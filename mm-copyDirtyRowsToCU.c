@@ -0,0 +1,53 @@
+int copyDirtyRowsToCU (float *M, uint64_t *resident, int cuAddress) {
+    // Copies to the CU just the rows of the NxN matrix M (in float, row
+    // major order) that have changed since it was last copied.  resident
+    // holds the N*N approx words last copied; it is compared with M and
+    // brought up to date.  The changed rows go one after another from
+    // cuAddress in CU Data Memory, in increasing order, and the list of
+    // them in dirtyRowCount, dirtyChipRow and dirtyApeRow, where the code
+    // from emitCopyDirtyRowsFromCUToApes reads them to update the apes.
+    // Returns how many rows changed.
+
+    uint16_t *old = (uint16_t *)resident;
+    uint16_t *new = (uint16_t *)approxM;
+    uint16_t chipRow[N];
+    uint16_t apeRow[N];
+    int count = 0;
+    int i;
+
+    // Rows are compared in approx, so a change too small to show in
+    // approx does not cost a copy.  Each changed row is moved down to
+    // follow the last one, which it can't overwrite, since no row moves
+    // up.
+    cvtApproxArray((scApprox *)approxM, M, N*N);
+    for (i=0; i<N; i++) {
+        if (memcmp(old + i*N, new + i*N, 2*N) != 0) {
+            memcpy(old + i*N, new + i*N, 2*N);
+            memmove(new + count*N, new + i*N, 2*N);
+            chipRow[count] = i / apeRows;
+            apeRow[count] = i % apeRows;
+            count++;
+        }
+    }
+
+    // The loop on the CU always makes at least one trip, so with nothing
+    // changed, list row 0 as it already is in the apes.
+    int listed = count;
+    if (count == 0) {
+        memcpy(new, old, 2*N);
+        chipRow[0] = 0;
+        apeRow[0] = 0;
+        listed = 1;
+    }
+
+    uint16_t listedWord = listed;
+    scWriteCUDataMemoryBlock(2*N*listed, (uintptr_t)new, cuAddress);
+    scWriteCUDataMemoryBlock(2*listed, (uintptr_t)chipRow,
+                             MemAddress(dirtyChipRow[0]));
+    scWriteCUDataMemoryBlock(2*listed, (uintptr_t)apeRow,
+                             MemAddress(dirtyApeRow[0]));
+    scWriteCUDataMemoryBlock(2, (uintptr_t)&listedWord,
+                             MemAddress(dirtyRowCount));
+
+    return count;
+} // End copyDirtyRowsToCU.
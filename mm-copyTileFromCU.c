@@ -0,0 +1,22 @@
+void copyTileFromCU (float *floatM, int rows, int cols,
+                     int tileRow, int tileCol, int cuAddress) {
+    // Copies an NxN tile from CU Data Memory at cuAddress to tile
+    // (tileRow, tileCol) of the rows x cols matrix floatM in the CPU (in
+    // row major order, and converted from approx to float).  The tiles
+    // are laid out the way cvtTile lays them out, and the zero padding on
+    // the bottom and right edges is dropped.
+    int row;
+
+    scReadCUDataMemoryBlock(2*N*N, (uintptr_t)approxM, cuAddress);
+
+    // Converts the part of each row of the tile that lies inside floatM
+    // to float.  width is how many columns of the tile that is.
+    scApprox *tile = (scApprox *)approxM;
+    int width = cols - tileCol*N;
+    if (width > N) width = N;
+    for (row=0; row<N && tileRow*N+row<rows; row++) {
+        cvtFloatArray(floatM + (tileRow*N+row)*cols + tileCol*N,
+                      tile + N*row, width);
+    }
+
+} // End copyTileFromCU.
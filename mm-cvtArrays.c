@@ -0,0 +1,105 @@
+// Bulk conversion between float and approx, for copying whole matrices
+// between the CPU and the CU.  These give exactly the same results as
+// calling cvtApprox and cvtFloat on each element.
+
+// With AVX2, both conversions look up 8 values at a time with gathers.
+// There is no SSE path:  SSE has no gather, and each value is a table
+// lookup, so SSE would make the same loads one at a time as the plain C.
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// approxToFloat[a] is cvtFloat(a), for every 16 bit approx value a.
+// Looking values up here is much faster than converting them one at a
+// time, and is exact, because the table was filled in by cvtFloat itself.
+float approxToFloat[1<<16];
+
+// floatToApprox[b] is cvtApprox(f) for every float f whose top 16 bits
+// (the sign, the exponent and the top 7 bits of the fraction) are b, if
+// they all convert to the same approx value, and -1 if they don't, in
+// which case cvtApprox converts them itself.  Converting rounds, and
+// rounding never goes back as the magnitude grows, so if the least and
+// greatest magnitudes with top bits b convert to the same value, so does
+// everything in between.  Infinities and NaNs are always left to
+// cvtApprox.
+int32_t floatToApprox[1<<16];
+
+void initCvtArrays () {
+    // Fills in approxToFloat and floatToApprox.  Call this after
+    // initSingularArithmetic and before the first bulk conversion.
+    int a, b;
+    for (a = 0; a < (1<<16); a++) {
+        approxToFloat[a] = cvtFloat((scApprox)a);
+    }
+    for (b = 0; b < (1<<16); b++) {
+        uint32_t lowBits = (uint32_t)b << 16;
+        uint32_t highBits = lowBits | 0xFFFF;
+        float low, high;
+        memcpy(&low, &lowBits, sizeof(float));
+        memcpy(&high, &highBits, sizeof(float));
+        scApprox approx = cvtApprox(low);
+        if (((b >> 7) & 0xFF) != 0xFF && cvtApprox(high) == approx) {
+            floatToApprox[b] = (uint16_t)approx;
+        } else {
+            floatToApprox[b] = -1;
+        }
+    }
+}
+
+scApprox cvtApproxByTable (float f) {
+    // Returns cvtApprox(f), from floatToApprox when it can.
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(float));
+    int32_t approx = floatToApprox[bits >> 16];
+    return approx >= 0 ? (scApprox)approx : cvtApprox(f);
+}
+
+void cvtFloatArray (float *dst, const scApprox *src, int n) {
+    // Converts the n approx values in src to float, into dst.
+    int i = 0;
+#ifdef __AVX2__
+    // Gather 8 table entries at a time, indexed by 8 approx values.
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        __m256i index = _mm256_cvtepu16_epi32(a);
+        _mm256_storeu_ps(dst + i,
+                         _mm256_i32gather_ps(approxToFloat, index, 4));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = approxToFloat[(uint16_t)src[i]];
+    }
+}
+
+void cvtApproxArray (scApprox *dst, const float *src, int n) {
+    // Converts the n float values in src to approx, into dst, looking
+    // each one up in floatToApprox by its top 16 bits.  cvtBenchmark
+    // checks the results against cvtApprox, and measures the speed.
+    int i = 0;
+#ifdef __AVX2__
+    // Gather 8 table entries at a time, indexed by the top bits of 8
+    // floats.  If any of the 8 needs cvtApprox, do those 8 one at a time.
+    for (; i + 8 <= n; i += 8) {
+        __m256i bits = _mm256_castps_si256(_mm256_loadu_ps(src + i));
+        __m256i approx = _mm256_i32gather_epi32((const int *)floatToApprox,
+                                                _mm256_srli_epi32(bits, 16),
+                                                4);
+        if (_mm256_movemask_ps(_mm256_castsi256_ps(approx)) != 0) {
+            int k;
+            for (k = i; k < i + 8; k++) {
+                dst[k] = cvtApproxByTable(src[k]);
+            }
+            continue;
+        }
+        // Pack the 8 values to 16 bits.  The pack works within each half
+        // of the register, so put the halves back in order after it.
+        __m256i packed = _mm256_permute4x64_epi64(
+            _mm256_packus_epi32(approx, approx), 0xD8);
+        _mm_storeu_si128((__m128i *)(dst + i),
+                         _mm256_castsi256_si128(packed));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = cvtApproxByTable(src[i]);
+    }
+}
@@ -0,0 +1,29 @@
+void cvtTile (float *floatM, int rows, int cols, int tileRow, int tileCol,
+              scApprox *tile) {
+    // Converts one NxN tile of the rows x cols matrix floatM (stored in
+    // row major order, in float format) into approx format in tile.
+
+    // Tile (tileRow, tileCol) holds the elements of floatM starting at
+    // floatM[tileRow*N][tileCol*N], in row major order.  The tiles on the
+    // bottom and right edges are padded with zeros, so rows and cols do
+    // not need to be multiples of N.  The zeros don't change the product,
+    // because they only ever multiply other padding.
+    scApprox zero = cvtApprox(0);
+    int row, col;
+
+    // width is how many columns of this tile lie inside floatM.
+    int width = cols - tileCol*N;
+    if (width > N) width = N;
+    for (row=0; row<N; row++) {
+        int r = tileRow*N + row;
+        col = 0;
+        if (r < rows) {
+            cvtApproxArray(tile + N*row, floatM + r*cols + tileCol*N, width);
+            col = width;
+        }
+        for (; col<N; col++) {
+            tile[N*row+col] = zero;
+        }
+    }
+
+} // End cvtTile.
@@ -0,0 +1,73 @@
+void emitApeCoordinates () {
+    // Emit code that gives every ape its row and column number in the
+    // NxN ape grid, and the masks derived from them, in the ape memory
+    // names apeRowNum, apeColNum, onDiagonal, onTopRow, onBottomRow,
+    // onLeftCol and onRightCol.  Ape memory keeps its values from one
+    // kernel to the next, so this only needs to run once per machine, and
+    // every kernel after that can use the names without recomputing them.
+
+    int i;
+
+    // Create variables in each ape for the ape’s row and column numbers.
+    // Set row and column to zero initially.  apeGet won't work directly on
+    // ape memory names, so we count in ape variables and save the counts
+    // at the end.  They are only needed here, so they go back to the
+    // pool of temporaries afterwards.
+    int scope = apeScopeBegin();
+    scExpr row = apeTemp(Int);
+    scExpr col = apeTemp(Int);
+    Set(row,IntConst(0));
+    Set(col,IntConst(0));
+
+    // We must number the row and column variables, because right now they are
+    // all set to zero.
+    for (i = 0; i < N; i++){
+        // Using apeGet from the North will give us a zero in the top row of
+        // Apes, since apeGet does not use a torus configuration.
+        eApeC(apeGet, row, row, getNorth);
+        Set(row, Add(row,IntConst(1)));
+
+        // Using apeGet from the West will give us a zero in the left-most
+        // column of Apes, since apeGet does not use a torus configuration.
+        eApeC(apeGet, col, col, getWest);
+        Set(col, Add(col,IntConst(1)));
+    }
+
+    // We added one too many IntConst(1)s, because we still want the extra
+    // shift in the for loop.  It’s easier to subtract IntConst(1) than to
+    // do another shift after the for loop.  Now we subtract IntConst(1).
+    Set(apeRowNum, Sub(row,IntConst(1)));
+    Set(apeColNum, Sub(col,IntConst(1)));
+    apeScopeEnd(scope);
+
+    // Uncomment the following trace commands to print the row and column
+    // of all the Apes.
+    //TraceOneRegisterAllApes(apeRowNum);
+    //TraceOneRegisterAllApes(apeColNum);
+
+    // Each mask is 1 in the apes it describes and 0 everywhere else.
+    // The masks are set with ApeIf, so mask mode must be on.
+    eCUC(cuSetMaskMode, _, _, 1);
+    Set(onDiagonal, IntConst(0));
+    Set(onTopRow, IntConst(0));
+    Set(onBottomRow, IntConst(0));
+    Set(onLeftCol, IntConst(0));
+    Set(onRightCol, IntConst(0));
+
+    ApeIf(Eq(apeRowNum, apeColNum));
+    Set(onDiagonal, IntConst(1));
+    ApeFi();
+    ApeIf(Eq(apeRowNum, IntConst(0)));
+    Set(onTopRow, IntConst(1));
+    ApeFi();
+    ApeIf(Eq(apeRowNum, IntConst(N-1)));
+    Set(onBottomRow, IntConst(1));
+    ApeFi();
+    ApeIf(Eq(apeColNum, IntConst(0)));
+    Set(onLeftCol, IntConst(1));
+    ApeFi();
+    ApeIf(Eq(apeColNum, IntConst(N-1)));
+    Set(onRightCol, IntConst(1));
+    ApeFi();
+
+} // End emitApeCoordinates.
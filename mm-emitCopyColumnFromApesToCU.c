@@ -0,0 +1,26 @@
+void emitCopyColumnFromApesToCU (int apeAddress, int col, int cuAddress) {
+    // Copies the N 16 bit data words in column col of the Ape grid, in
+    // Ape[0..N-1, col]Mem[apeAddress], to CU Data Memory starting at
+    // cuAddress.  Only N words cross to the CU, rather than the N*N of
+    // emitCopyMatrixFromApesToCU.
+    // This code uses ape register zero (apeR0), destroying what was in it.
+    int chipRow;
+
+    eControl(controlOpReserveApeReg,apeR0);
+    eApeC(apeLoad, apeR0, _, apeAddress);
+    eCUX(cuSetRWAddress, _, _, cuAddress);
+
+    // The column lives in one chip column and one ape column of each chip.
+    // Leaving out rwIncApeCol keeps every read in that ape column, and the
+    // CUFor steps down the ape rows of each chip.
+    eCUC(cuSet, cuRChipCol, _, col / apeCols);
+    eCUC(cuSet, cuRApeCol, _, col % apeCols);
+    for (chipRow=0; chipRow<chipRows; chipRow++) {
+        eCUC(cuSet, cuRChipRow, _, chipRow);
+        CUFor(cuRApeRow, IntConst(0), IntConst(apeRows-1), IntConst(1));
+        eCUC(cuRead, _, rwIgnoreMasks|rwUseCUMemory, (propDelay<<8)|apeR0);
+        CUForEnd();
+    }
+
+    eControl(controlOpReleaseApeReg,apeR0);
+} // End emitCopyColumnFromApesToCU.
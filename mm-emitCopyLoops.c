@@ -0,0 +1,97 @@
+void emitCopyRow (int op, int operand) {
+    // Emits op (cuWrite or cuRead) once for every ape in the row that
+    // cuRChipRow and cuRApeRow point at, across every chip column, moving
+    // through CU memory one word per ape.
+    // Each op increments cuRApeCol itself (rwIncApeCol), so only the start
+    // of each chip's row needs setting.
+    int flags = rwIgnoreMasks|rwUseCUMemory|rwIncApeCol;
+    int chipCol, col;
+
+    if (copyUnroll == 0) {
+        // Fully unrolled:  the chip columns and the ape columns are C for
+        // loops, so there is one op per column and the kernel grows with
+        // the width of the grid.
+        for (chipCol=0; chipCol<chipCols; chipCol++) {
+            eCUC(cuSet, cuRChipCol, _, chipCol);
+            copyInstructions++;
+            eCUC(cuSet, cuRApeCol, _, 0);
+            copyInstructions++;
+            for (col=0; col<apeCols; col++) {
+                eCUC(op, _, flags, operand);
+                copyInstructions++;
+            }
+        }
+        return;
+    }
+
+    // Compact:  the chip columns are a CUFor, and the columns of each chip
+    // go round a CUFor on cuR12 with copyUnroll ops in its body, followed
+    // by the apeCols % copyUnroll columns left over.  This costs one loop
+    // test per copyUnroll columns.
+    int unroll = copyUnroll < apeCols ? copyUnroll : apeCols;
+    int trips = apeCols / unroll;
+    int remainder = apeCols % unroll;
+
+    CUFor(cuRChipCol, IntConst(0), IntConst(chipCols-1), IntConst(1));
+    copyInstructions++;
+    eCUC(cuSet, cuRApeCol, _, 0);
+    copyInstructions++;
+    if (trips > 1) {
+        CUFor(cuR12, IntConst(0), IntConst(trips-1), IntConst(1));
+        copyInstructions++;
+    }
+    for (col=0; col<unroll; col++) {
+        eCUC(op, _, flags, operand);
+        copyInstructions++;
+    }
+    if (trips > 1) {
+        CUForEnd();
+        copyInstructions++;
+    }
+    for (col=0; col<remainder; col++) {
+        eCUC(op, _, flags, operand);
+        copyInstructions++;
+    }
+    CUForEnd();
+    copyInstructions++;
+} // End emitCopyRow.
+
+void emitCopyLoops (int op, int operand) {
+    // Emits the loops that run the CU instruction op (cuWrite or cuRead)
+    // once for every ape in the grid, in row major order, moving through
+    // CU memory one word per ape.
+
+    // Row r of the matrix lives in ape row r % apeRows of chip row
+    // r / apeRows, and likewise for columns.  The CU registers cuRChipRow
+    // and cuRChipCol pick the chip that op talks to, and cuRApeRow and
+    // cuRApeCol pick the ape within that chip.  To keep CU memory in row
+    // major order, each ape row visits every chip column in turn before
+    // moving down to the next ape row, in emitCopyRow.
+    int chipRow;
+
+    if (copyUnroll == 0) {
+        // Only the ape rows are a CUFor.
+        for (chipRow=0; chipRow<chipRows; chipRow++) {
+            eCUC(cuSet, cuRChipRow, _, chipRow);
+            copyInstructions++;
+            CUFor(cuRApeRow, IntConst(0), IntConst(apeRows-1), IntConst(1));
+            copyInstructions++;
+            emitCopyRow(op, operand);
+            CUForEnd();
+            copyInstructions++;
+        }
+        return;
+    }
+
+    // Every loop is a CUFor, so the size of the kernel depends only on
+    // copyUnroll, not on the size of the grid.
+    CUFor(cuRChipRow, IntConst(0), IntConst(chipRows-1), IntConst(1));
+    copyInstructions++;
+    CUFor(cuRApeRow, IntConst(0), IntConst(apeRows-1), IntConst(1));
+    copyInstructions++;
+    emitCopyRow(op, operand);
+    CUForEnd();
+    copyInstructions++;
+    CUForEnd();
+    copyInstructions++;
+} // End emitCopyLoops.
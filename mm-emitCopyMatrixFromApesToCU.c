@@ -1,41 +1,27 @@
 void emitCopyMatrixFromApesToCU(int apeAddress, int cuAddress) {
     // Copies N*N 16 bit data words from the Ape grid, in
     // Ape[0..N-1, 0..N-1]Mem[apeAddress], to CU Data Memory starting at
-    // cuAddress.
-    // This code uses CU register 11 (cuR11) and ape register zero (apeR0),
-    // destroying what was in those locations.
+    // cuAddress.  The Ape grid may be spread over several chips.
+    // This code uses ape register zero (apeR0), and with copyUnroll set CU
+    // register 12 (cuR12), destroying what was in those locations.
 
     // Reserves apeR0 register for A matrix.
     eControl(controlOpReserveApeReg,apeR0);
 
     // Loads matrix from the apeAddress given into apeR0.
     eApeC(apeLoad, apeR0, _, apeAddress);
-
-    // Reads the matrix into CU Data memory.
-    // First, sets the chip row and column to start at zero.
-    // HELP? Limited understanding of why this is necessary.
-    eCUC(cuSet, cuRChipRow, _, 0);
-    eCUC(cuSet, cuRChipCol, _, 0);
+    copyInstructions++;
 
     // Sets the location in memory to the given cuAddress.
     eCUX(cuSetRWAddress, _, _, cuAddress);
+    copyInstructions++;
 
-    // For every ape row, starting at row 0, working incrementally up
-    // until row N-1...
-    int col;
-    CUFor(cuRApeRow, IntConst(0), IntConst(N-1), IntConst(1));
-    // Starts at ape column zero, and works it’s way up the columns.
-    eCUC(cuSet, cuRApeCol, _, 0);
-    for (col=0; col<N; col++) {
-        int propDelay = 4;  // This delay allows the CU enough time to
-        // complete its previous command.
-        // The cu reads each ape register 0 into its data memory.
-        eCUC(cuRead, _, rwIgnoreMasks|rwUseCUMemory|rwIncApeCol,
-             (propDelay<<8)|apeR0);
-    }
-    CUForEnd();
+    // Reads the matrix into CU Data memory, in row major order.  The loops
+    // are the same as in emitCopyMatrixFromCUToApes.
+    // The cu reads each ape register 0 into its data memory, waiting
+    // propDelay cycles for each word to arrive (see calibratePropDelay).
+    emitCopyLoops(cuRead, (propDelay<<8)|apeR0);
 
     // Releases apeR0.
     eControl(controlOpReleaseApeReg,apeR0);
-
 } // End emitCopyMatrixFromApesToCU.
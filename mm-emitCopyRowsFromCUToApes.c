@@ -0,0 +1,63 @@
+void emitCopyRowsFromCUToApes (int cuAddress, int apeAddress,
+                               int rows[], int rowCount) {
+    // Copies just the given rows of the NxN matrix in CU Data Memory
+    // starting at cuAddress (row major order) to the same rows of the Ape
+    // grid, in Ape[row, 0..N-1]Mem[apeAddress].  The other rows of the
+    // apes keep what they had.  The rows are fixed when the code is
+    // emitted; emitCopyDirtyRowsFromCUToApes reads them when it runs.
+    // With copyUnroll set, this code uses CU register 12 (cuR12),
+    // destroying what was in it.
+    int k;
+
+    for (k=0; k<rowCount; k++) {
+        int row = rows[k];
+
+        // Point the CU at the start of the row in CU memory, and at the
+        // chip and ape row holding it, then copy across the row the same
+        // way emitCopyMatrixFromCUToApes does.
+        eCUX(cuSetRWAddress, _, _, cuAddress + row*N);
+        eCUC(cuSet, cuRChipRow, _, row / apeRows);
+        eCUC(cuSet, cuRApeRow, _, row % apeRows);
+        emitCopyRow(cuWrite, apeAddress);
+    }
+} // End emitCopyRowsFromCUToApes.
+
+void emitCopyDirtyRowsFromCUToApes (int cuAddress, int apeAddress) {
+    // Copies the rows that copyDirtyRowsToCU put one after another at
+    // cuAddress in CU Data Memory to their rows of the Ape grid, in
+    // Ape[row, 0..N-1]Mem[apeAddress].  Unlike emitCopyRowsFromCUToApes,
+    // the rows are not known when the code is emitted:  the S1 reads the
+    // list from dirtyRowCount, dirtyChipRow and dirtyApeRow when it runs,
+    // so the same code, in a CUFor or run again, copies whatever rows the
+    // CPU has changed since.  The list is left as it was, so running the
+    // code again without a new list copies the same rows again.
+    // This code uses CU register 10 (cuR10), destroying what was in it,
+    // and with copyUnroll set, cuR12 too.
+    int k;
+
+    // There is no reading CU memory at an address held in a register, so
+    // each trip takes its row from the front of the list and moves the
+    // rest down one.  That would use the list up, so the trips walk a
+    // copy of it, made here, each time the code runs.
+    for (k=0; k<N; k++) {
+        Set(dirtyChipWalk[k], dirtyChipRow[k]);
+        Set(dirtyApeWalk[k], dirtyApeRow[k]);
+    }
+
+    // The rows follow each other in CU memory, so the address only needs
+    // setting once; each cuWrite moves it on.
+    eCUX(cuSetRWAddress, _, _, cuAddress);
+    CUFor(cuR10, IntConst(1), dirtyRowCount, IntConst(1));
+    Set(cuRChipRow, dirtyChipWalk[0]);
+    Set(cuRApeRow, dirtyApeWalk[0]);
+    emitCopyRow(cuWrite, apeAddress);
+
+    // Move the rest of the copy down one, for the next trip to find its
+    // row at the front.  This costs 2*(N-1) CU instructions a row, against
+    // the N cuWrites of the row itself, and the copy 2*N more a run.
+    for (k=0; k<N-1; k++) {
+        Set(dirtyChipWalk[k], dirtyChipWalk[k+1]);
+        Set(dirtyApeWalk[k], dirtyApeWalk[k+1]);
+    }
+    CUForEnd();
+} // End emitCopyDirtyRowsFromCUToApes.
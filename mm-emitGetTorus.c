@@ -1,12 +1,84 @@
 // Used getApe before, but that isn't set up for a torus configuration,
 // which we're using in the matrix multiply.  HELP: don't fully understand.
-void emitGetTorus(scExpr x, int dir){
+
+// The number of apeGetGMove cycles a torus get waits for the value to
+// travel to the neighboring ape.  This is the same on every grid, since
+// the value only travels one hop.
+int torusGetMoves = 16;
+
+int torusExtent(int dir){
+    // Returns the number of apes around the torus in direction dir.
+    if (dir == getEast || dir == getWest) return chipCols*apeCols;
+    return chipRows*apeRows;
+}
+
+int torusOpposite(int dir){
+    // Returns the direction opposite to dir.
+    if (dir == getEast) return getWest;
+    if (dir == getWest) return getEast;
+    if (dir == getNorth) return getSouth;
+    return getNorth;
+}
+
+// A torus get happens in three parts, so that the caller can emit other
+// ape instructions while the value travels.  emitGetTorusStart sends the
+// current value of x into the network.  emitGetTorusMoves waits for it to
+// travel.  emitGetTorusFinish writes the value that arrived into x.  Until
+// emitGetTorusFinish, x still holds its old value, so other instructions
+// may read it in between.
+void emitGetTorusStart(scExpr x, int dir){
     eApeC(apeGetGStart, _, _, dir);
     eApeC(apeGetGStartDone, _, x, _);
+}
+
+void emitGetTorusMoves(int moves){
     int i;
-    for(i = 0; i< 16; i++){
+    for(i = 0; i < moves; i++){
         eApeC(apeGetGMove, _, _, _);
     }
+}
+
+void emitGetTorusFinish(scExpr x, int dir){
     eApeC(apeGetGMoveDone, _, _, _);
     eApeC(apeGetGEnd, x, x, dir);
 }
+
+void emitGetTorus(scExpr x, int dir){
+    emitGetTorusStart(x, dir);
+    emitGetTorusMoves(torusGetMoves);
+    emitGetTorusFinish(x, dir);
+}
+
+void emitGetTorusHops(scExpr x, int dir, int hops){
+    // Like emitGetTorus, but every ape gets the value of x from the ape
+    // hops positions away in direction dir, wrapping around the torus.
+    // hops may be negative, or larger than the torus, and the get takes
+    // the shorter way around:  on an 8 wide grid, 7 hops East is done as
+    // 1 hop West, and 8 hops is nothing at all.
+    int extent = torusExtent(dir);
+    hops %= extent;
+    if (hops < 0) hops += extent;
+    if (hops > extent/2) {
+        dir = torusOpposite(dir);
+        hops = extent - hops;
+    }
+
+    // Each get only reaches the neighboring ape, so the value makes one
+    // get per hop, of torusGetMoves moves each.  (Whether one get with
+    // more moves carries the value further isn't known, so this doesn't
+    // rely on it.)
+    //
+    // So the emitters that work in rounds of 1, 2, 4, ... hops (the
+    // skews, the reductions and emitMatrixVectorMul) still make N-1 gets
+    // along a line in all, against N for one hop at a time.  What the
+    // rounds save is the work between the gets:  log2(N) masked rounds,
+    // adds or compares in place of about N.  On the 8x8 grid the skew is 7
+    // gets and 3 masked rounds, each a compare, a Set, a Sub and a reload,
+    // in place of 8 gets and 8 masked rounds of a compare, a Set and a
+    // reload.  The gets are most of it:  each one is 20 ape instructions,
+    // with torusGetMoves moves.
+    int i;
+    for(i = 0; i < hops; i++){
+        emitGetTorus(x, dir);
+    }
+}
@@ -1,120 +1,175 @@
-void emitMatrixMul () {
-    // Emit code for matrix multiply:  A = A + B.
-    // See Cypher and Sanz 5.6 for a description of this algorithm.
-    
-    int i;
-    
-    // Create variables in each ape for the ape’s row and column numbers.
-    // Set row and column to zero initially.
-    DeclareApeVar(row, Int);
-    DeclareApeVar(col, Int);
-    Set(row,IntConst(0));
-    Set(col,IntConst(0));
-
-    // Need to use Ape variables to manipulate matrices A and B
-    DeclareApeVar(Aloaded, Approx);
-    Set(Aloaded, A);
-    DeclareApeVar(Bloaded, Approx);
-    Set(Bloaded, B);
-    
-    // Preserve matrix B, since this function should not alter
-    // it permanently.
-    DeclareApeVar(Bsaved, Approx);
-    Set(Bsaved, B);
-
-    // We must number the row and column variables, because right now they are
-    // all set to zero.
-    for (i = 0; i < N; i++){
-        // Using apeGet from the North will give us a zero in the top row of
-        // Apes, since apeGet does not use a torus configuration.
-        eApeC(apeGet, row, row, getNorth);
-        Set(row, Add(row,IntConst(1)));
-
-        // Using apeGet from the West will give us a zero in the left-most
-        // column of Apes, since apeGet does not use a torus configuration.
-        eApeC(apeGet, col, col, getWest);
-        Set(col, Add(col,IntConst(1)));
+// The ape variables that one batch of matrix multiplies works in.  Keeping
+// them together lets the phases of the multiply (start, skew, loop and
+// end) be emitted separately, for instance into separate kernels when
+// timing each phase.
+typedef struct {
+    int count;                         // Number of multiplies in the batch.
+    scExpr *As;                        // The A matrices, in ape memory.
+    scExpr *Bs;                        // The B matrices, in ape memory.
+    scExpr Aloaded[MAX_BATCH];
+    scExpr Bloaded[MAX_BATCH];
+    scExpr Bsaved[MAX_BATCH];
+    scExpr runningTotal[MAX_BATCH];
+    scExpr product[MAX_BATCH];
+    int apeScope;                      // Mark of the temporaries' scope.
+} MatrixMulVars;
+
+void emitMatrixMulStart (MatrixMulVars *v, scExpr *As, scExpr *Bs,
+                         int count) {
+    // Emit the start of count independent matrix multiplies:
+    // As[k] = As[k] * Bs[k], for k from 0 to count-1.
+    // This takes the ape variables the multiplies work in from the pool,
+    // and emitMatrixMulEnd gives them back.
+    int k;
+
+    if (count > MAX_BATCH) {
+        printf("Batch of %d multiplies is more than MAX_BATCH (%d).\n",
+               count, MAX_BATCH);
+        exit(1);
     }
+    v->count = count;
+    v->As = As;
+    v->Bs = Bs;
+    v->apeScope = apeScopeBegin();
 
-    // We added one too many IntConst(1)s, because we still want the extra
-    // shift in the for loop.  It’s easier to subtract IntConst(1) than to
-    // do another shift after the for loop.  Now we subtract IntConst(1).
-    Set(row, Sub(row,IntConst(1)));   // Sub() is a subtraction function found
-                                      // in scNova.h
-    Set(col, Sub(col,IntConst(1)));
+    // Need to use Ape variables to manipulate matrices A and B.
+    // Preserve each matrix B, since the multiply should not alter
+    // them permanently.
+    for (k = 0; k < count; k++) {
+        v->Aloaded[k] = apeTemp(Approx);
+        v->Bloaded[k] = apeTemp(Approx);
+        v->Bsaved[k] = apeTemp(Approx);
+        Set(v->Aloaded[k], As[k]);
+        Set(v->Bloaded[k], Bs[k]);
+        Set(v->Bsaved[k], Bs[k]);
+    }
 
-    // Uncomment the following trace commands to print the row and column
-    // of all the Apes.
-    //TraceOneRegisterAllApes(row);
-    //TraceOneRegisterAllApes(col);
+    // We want a variable in each ape that holds the running total of each
+    // matrix multiplication.
+    // In the pipelined loop, each product is computed into its own
+    // variable while Aloaded travels, and added to the running total while
+    // Bloaded travels.
+    for (k = 0; k < count; k++) {
+        v->runningTotal[k] = apeTemp(Approx);
+        v->product[k] = apeTemp(Approx);
+    }
+} // End emitMatrixMulStart.
+
+void emitMatrixMulSkew (MatrixMulVars *v) {
+    // Emit the skew of a batch of matrix multiplies, which lines up the
+    // elements of each A and B that are multiplied together first.
+    int k;
+    int count = v->count;
+    scExpr *As = v->As;
+    scExpr *Bs = v->Bs;
+    scExpr *Aloaded = v->Aloaded;
+    scExpr *Bloaded = v->Bloaded;
 
     // Shift each row i of matrix A to the left i times.
     // Shift each column j of matrix B upwards j times.
-    for (i = 0; i < N; i++){
+    //
+    // Rather than shifting one position at a time, N times, we shift by
+    // the binary digits of i (and j).  Each round shifts by a power of
+    // two, hops, starting with the largest power of two below N.  A row
+    // takes the shifted values only if it still has at least hops
+    // positions left to go, so after log2(N) rounds row i has been shifted
+    // exactly i times.  rowShift and colShift count how far each ape still
+    // has to shift, starting from the ape's row and column numbers, which
+    // emitApeCoordinates has already computed.  Every multiply in the
+    // batch shifts by the same amounts, so they share these counts.
+    //
+    // This saves masked rounds, not gets; emitGetTorusHops says what the
+    // rounds cost.
+    scExpr rowShift = apeTemp(Int);
+    scExpr colShift = apeTemp(Int);
+    Set(rowShift, apeRowNum);
+    Set(colShift, apeColNum);
+
+    int hops = 1;
+    while (2*hops < N) hops *= 2;
+
+    for (; hops > 0; hops /= 2){
 
         // If you want to see the shifts as they happen, uncomment
         // the following section of trace commands.
-        // Each time the value that was in A[3][6] should have moved to A[3][5].
-        // Each time the value that was in B[3][5] should have moved to B[4][5].
-        // Should only shift 3 times for matrix A, because we're looking at
-        // row 3.
-        // Should only shift 5 times for matrix B, because we're looking at
-        // column 5.
-        //TraceMessage("\nMatrix A[3][5] and A[3][6]\n");
-        //TraceOneRegisterOneApe(A, 3, 5);
-        //TraceOneRegisterOneApe(A, 3, 6);
-        //TraceMessage("\nMatrix B[3][5] and B[4][5].\n");
-        //TraceOneRegisterOneApe(B, 3, 5);
-        //TraceOneRegisterOneApe(B, 4, 5);
+        // Row 3 should shift by 2 and then by 1, and column 5 should
+        // shift by 4 and then by 1.
+        //TraceMessage("\nMatrix A, row 3, and matrix B, column 5\n");
+        //TraceOneRegisterOneApe(As[0], 3, 5);
+        //TraceOneRegisterOneApe(Bs[0], 3, 5);
         //
         // Alternatively:
-        // TraceOneRegisterAllApes(A);
-        // TraceOneRegisterAllApes(B);
-        
-        // The Aloaded matrix is the same as matrix A.  Shift every
-        // Aloaded value to the left by one position. 
-        emitGetTorus(Aloaded, getEast);
-        
-        // Check whether the row number of each ape is greater than i.
-        // This masks the other rows.
-        ApeIf(Gt(row, IntConst(i)));
-        // If the row number is greater than i, then we want the matrix
-        // A value in that row to shift to the left by one position.
-        // This is easily done by setting the non-masked values of matrix
-        // A to equal the corresponding values of Aloaded, which we
-        // already shifted.
-        Set(A, Aloaded);
+        // TraceOneRegisterAllApes(As[0]);
+        // TraceOneRegisterAllApes(Bs[0]);
+
+        // The Aloaded matrices are the same as the A matrices.  Shift
+        // every Aloaded value to the left by hops positions.
+        for (k = 0; k < count; k++) {
+            emitGetTorusHops(Aloaded[k], getEast, hops);
+        }
+
+        // Check whether the row still has at least hops positions to
+        // shift.  This masks the other rows.
+        ApeIf(Gt(rowShift, IntConst(hops-1)));
+        // If so, the row takes the shifted values, and has hops fewer
+        // positions left to shift.
+        for (k = 0; k < count; k++) {
+            Set(As[k], Aloaded[k]);
+        }
+        Set(rowShift, Sub(rowShift, IntConst(hops)));
         ApeFi(); // Clear the masking.
 
-        // The Bloaded matrix is the same as matrix B.  Shift every
-        // Bloaded value upwards by one position.
-        emitGetTorus(Bloaded, getSouth);
-        
-        // Check whether the column number of each ape is greater than i.
-        // This will mask apes in smaller columns.
-        ApeIf(Gt(col, IntConst(i)));
-        // If the  column number is greater than i, then we want to shift
-        // the matrix B values in that column upwards by one position.
-        // We do this by setting the non-masked values of matrix B to equal
-        // the corresponding values of Bloaded, which we already shifted.
-        Set(B, Bloaded);
+        // The next round shifts each A as it is now, not the Aloaded we
+        // already shifted.
+        for (k = 0; k < count; k++) {
+            Set(Aloaded[k], As[k]);
+        }
+
+        // The Bloaded matrices are the same as the B matrices.  Shift
+        // every Bloaded value upwards by hops positions.
+        for (k = 0; k < count; k++) {
+            emitGetTorusHops(Bloaded[k], getSouth, hops);
+        }
+
+        // Check whether the column still has at least hops positions to
+        // shift.  This will mask the other columns.
+        ApeIf(Gt(colShift, IntConst(hops-1)));
+        // If so, the column takes the shifted values, and has hops fewer
+        // positions left to shift.
+        for (k = 0; k < count; k++) {
+            Set(Bs[k], Bloaded[k]);
+        }
+        Set(colShift, Sub(colShift, IntConst(hops)));
         ApeFi(); // Clear the masking from ApeIf().
-                
-    } // Ends for(i=0; i < N; i++).
+
+        for (k = 0; k < count; k++) {
+            Set(Bloaded[k], Bs[k]);
+        }
+
+    } // Ends for(; hops > 0; hops /= 2).
 
     // emitGetTorus won’t allow us to get values directly from matrix A
-    // or matrix B.  In order to use emitGetTorus we need to use a level
-    // of misdirection and use the ape variables Aloaded and Bloaded.
-    // First, we reset Aloaded and Bloaded to equal matrix A and matrix B.
-    Set(Aloaded, A);
-    Set(Bloaded, B);
-    
-    // We want a variable in each ape that holds the running total of the
-    // matrix multiplication.
-    DeclareApeVar(runningTotal, Approx);
-    // Initially the running total is set to zero.
-    Set(runningTotal,ApproxConst(0));
-    
+    // or matrix B.  That is why we use a level of misdirection and use
+    // the ape variables Aloaded and Bloaded, which the skew left equal to
+    // the skewed A and B matrices.
+
+} // End emitMatrixMulSkew.
+
+void emitMatrixMulLoop (MatrixMulVars *v) {
+    // Emit the main loop of a batch of matrix multiplies, which leaves
+    // each product in runningTotal.
+    int i, k;
+    int count = v->count;
+    scExpr *Aloaded = v->Aloaded;
+    scExpr *Bloaded = v->Bloaded;
+    scExpr *runningTotal = v->runningTotal;
+    scExpr *product = v->product;
+
+    // Initially the running totals are set to zero.
+    for (k = 0; k < count; k++) {
+        Set(runningTotal[k], ApproxConst(0));
+    }
+
     i = 0;
 
     // Multiplies the Aloaded and Bloaded elements in each Ape and adds
@@ -126,25 +181,88 @@ void emitMatrixMul () {
         // If we want to see the shifts as they happen, uncomment
         // the following Trace functions.
         //TraceMessage("runningTotal, Aloaded, Bloaded:\n");
-        //TraceOneRegisterAllApes(runningTotal);
-        //TraceOneRegisterAllApes(Aloaded);
-        //TraceOneRegisterAllApes(Bloaded);
-        
-        // runningTotal = runningTotal + (Aloaded * Bloaded)
-        Set(runningTotal, Add(runningTotal, Mul(Aloaded, Bloaded)));
-        
-        emitGetTorus(Aloaded, getEast); // Shifts Aloaded to the left.
-        emitGetTorus(Bloaded, getSouth); // Shifts Bloaded upwards.
-        
+        //TraceOneRegisterAllApes(runningTotal[0]);
+        //TraceOneRegisterAllApes(Aloaded[0]);
+        //TraceOneRegisterAllApes(Bloaded[0]);
+
+        for (k = 0; k < count; k++) {
+            if (pipelineCannonLoop) {
+                // Sends Aloaded into the network first.  Aloaded keeps
+                // its old value until emitGetTorusFinish, so the multiply
+                // still sees the values that belong to this step.  All
+                // torusGetMoves moves still follow, since nothing says the
+                // multiply's cycles move the word along; the multiply
+                // only fills the gap after the start.
+                emitGetTorusStart(Aloaded[k], getEast);
+                Set(product[k], Mul(Aloaded[k], Bloaded[k]));
+                emitGetTorusMoves(torusGetMoves);
+                emitGetTorusFinish(Aloaded[k], getEast); // Shifts left.
+
+                // The network carries one direction at a time, so
+                // Bloaded follows Aloaded, and the add fills its gap.
+                emitGetTorusStart(Bloaded[k], getSouth);
+                Set(runningTotal[k], Add(runningTotal[k], product[k]));
+                emitGetTorusMoves(torusGetMoves);
+                emitGetTorusFinish(Bloaded[k], getSouth); // Shifts upwards.
+            } else {
+                // runningTotal = runningTotal + (Aloaded * Bloaded)
+                Set(runningTotal[k],
+                    Add(runningTotal[k], Mul(Aloaded[k], Bloaded[k])));
+
+                emitGetTorus(Aloaded[k], getEast); // Shifts to the left.
+                emitGetTorus(Bloaded[k], getSouth); // Shifts upwards.
+            }
+        }
+
         i++;
     } while(i < N);
 
-    // Resets matrix B to what it was before the multiplication, since we
-    // didn’t want this function to alter matrix B.
-    Set(B, Bsaved);
-    
-    // Sets matrix A equal to the runningTotal.
-    // Matrix A now will hold the result of matrix A * B.
-    Set(A, runningTotal);
-    
+} // End emitMatrixMulLoop.
+
+void emitMatrixMulEnd (MatrixMulVars *v) {
+    // Emit the end of a batch of matrix multiplies, which puts each
+    // product in its A and puts each B back the way it was, and gives
+    // the ape variables back to the pool.
+    int k;
+    for (k = 0; k < v->count; k++) {
+        // Resets matrix B to what it was before the multiplication, since
+        // we didn’t want this function to alter matrix B.
+        Set(v->Bs[k], v->Bsaved[k]);
+
+        // Sets matrix A equal to the runningTotal.
+        // Matrix A now will hold the result of matrix A * B.
+        Set(v->As[k], v->runningTotal[k]);
+    }
+    apeScopeEnd(v->apeScope);
+} // End emitMatrixMulEnd.
+
+void emitMatrixMulBatch (scExpr *As, scExpr *Bs, int count) {
+    // Emit code for count independent matrix multiplies:
+    // As[k] = As[k] * Bs[k], for k from 0 to count-1.
+    //
+    // All of the multiplies run in one pass over the algorithm, so the
+    // masks of the skew and the loop around the shifts are paid for once
+    // per batch, not once per multiply.  A batch needs ape memory for
+    // every pair of matrices at once, so it uses emitMatrixMulLean, which
+    // takes two or three ape variables per multiply rather than the five
+    // below, and unskews each B to put it back.
+    emitMatrixMulLean(As, Bs, count, 1);
+} // End of batched matrix multiplication function.
+
+void emitMatrixMul () {
+    // Emit code for matrix multiply:  A = A * B.
+    // See Cypher and Sanz 5.6 for a description of this algorithm.
+    scExpr As[1];
+    scExpr Bs[1];
+    As[0] = A;
+    Bs[0] = B;
+    MatrixMulVars v;
+    emitMatrixMulStart(&v, As, Bs, 1);
+    ProfileBegin("skew");
+    emitMatrixMulSkew(&v);
+    ProfileEnd();
+    ProfileBegin("multiply_loop");
+    emitMatrixMulLoop(&v);
+    ProfileEnd();
+    emitMatrixMulEnd(&v);
 } // End of matrix multiplication function.
@@ -0,0 +1,115 @@
+// A matrix multiply that uses as little ape memory as it can.
+//
+// emitMatrixMul keeps five ape variables for each multiply:  Aloaded
+// and Bloaded travel round the torus, Bsaved keeps B so it can be put
+// back, and runningTotal and product hold the sum.  Here the skew shifts
+// A and B where they are, in ape memory, with Aloaded and Bloaded only as
+// the copies that travel, and the sum builds up in A itself, which is not
+// needed once Aloaded has it.  B is put back by shifting it the other way
+// (an unskew), and only if the caller wants it back.  That leaves two
+// ape variables per multiply, three in the pipelined loop, and one shift
+// count for the whole batch.
+//
+// A and B must be different ape memory names, since each is shifted
+// where it is.  To square a matrix, copy it first, as emitMatrixPower
+// does.
+
+void emitSkewInPlace (scExpr *M, scExpr *loaded, int count, int dir,
+                      scExpr coordinate, scExpr shift) {
+    // Emit code that shifts each line of every matrix M[k] in ape memory
+    // by its coordinate, in direction dir, as in emitMatrixMulSkew:  one
+    // round per power of two, the line taking the shifted values only if
+    // it still has at least hops positions to go (emitGetTorusHops says
+    // what the rounds cost).  loaded[k] are ape variables for the values
+    // that travel, and shift an Int ape variable for the count of
+    // positions left.
+    int k;
+    int hops = 1;
+    while (2*hops < N) hops *= 2;
+
+    Set(shift, coordinate);
+    for (; hops > 0; hops /= 2) {
+        for (k = 0; k < count; k++) {
+            Set(loaded[k], M[k]);
+            emitGetTorusHops(loaded[k], dir, hops);
+        }
+        ApeIf(Gt(shift, IntConst(hops-1)));
+        for (k = 0; k < count; k++) {
+            Set(M[k], loaded[k]);
+        }
+        Set(shift, Sub(shift, IntConst(hops)));
+        ApeFi();
+    }
+}
+
+void emitMatrixMulLean (scExpr *As, scExpr *Bs, int count, int restoreB) {
+    // Emit code for count independent matrix multiplies:
+    // As[k] = As[k] * Bs[k], for k from 0 to count-1.  If restoreB is 0,
+    // each B is left skewed, which saves the unskew when B is not needed
+    // again.
+    // See Cypher and Sanz 5.6 for a description of this algorithm.
+    int i, k;
+    scExpr Aloaded[MAX_BATCH];
+    scExpr Bloaded[MAX_BATCH];
+    scExpr product[MAX_BATCH];
+
+    if (count > MAX_BATCH) {
+        printf("Batch of %d multiplies is more than MAX_BATCH (%d).\n",
+               count, MAX_BATCH);
+        exit(1);
+    }
+    int scope = apeScopeBegin();
+    scExpr shift = apeTemp(Int);
+    for (k = 0; k < count; k++) {
+        Aloaded[k] = apeTemp(Approx);
+        Bloaded[k] = apeTemp(Approx);
+        if (pipelineCannonLoop) {
+            product[k] = apeTemp(Approx);
+        }
+    }
+
+    // Shift each row i of A to the left i times, and each column j of B
+    // upwards j times, then start the travelling copies from there.
+    ProfileBegin("skew");
+    emitSkewInPlace(As, Aloaded, count, getEast, apeRowNum, shift);
+    emitSkewInPlace(Bs, Bloaded, count, getSouth, apeColNum, shift);
+    for (k = 0; k < count; k++) {
+        Set(Aloaded[k], As[k]);
+        Set(Bloaded[k], Bs[k]);
+        Set(As[k], ApproxConst(0));
+    }
+    ProfileEnd();
+
+    // The main loop, as in emitMatrixMulLoop, adding into A.  The last
+    // step has nothing left to shift.
+    ProfileBegin("multiply_loop");
+    for (i = 0; i < N; i++) {
+        for (k = 0; k < count; k++) {
+            if (i == N-1) {
+                Set(As[k], Add(As[k], Mul(Aloaded[k], Bloaded[k])));
+            } else if (pipelineCannonLoop) {
+                emitGetTorusStart(Aloaded[k], getEast);
+                Set(product[k], Mul(Aloaded[k], Bloaded[k]));
+                emitGetTorusMoves(torusGetMoves);
+                emitGetTorusFinish(Aloaded[k], getEast);
+
+                emitGetTorusStart(Bloaded[k], getSouth);
+                Set(As[k], Add(As[k], product[k]));
+                emitGetTorusMoves(torusGetMoves);
+                emitGetTorusFinish(Bloaded[k], getSouth);
+            } else {
+                Set(As[k], Add(As[k], Mul(Aloaded[k], Bloaded[k])));
+                emitGetTorus(Aloaded[k], getEast);
+                emitGetTorus(Bloaded[k], getSouth);
+            }
+        }
+    }
+    ProfileEnd();
+
+    // Each B is still skewed in ape memory.  Shifting column j down j
+    // times puts it back.
+    if (restoreB) {
+        emitSkewInPlace(Bs, Bloaded, count, getNorth, apeColNum, shift);
+    }
+    apeScopeEnd(scope);
+} // End emitMatrixMulLean.
@@ -0,0 +1,75 @@
+void emitMatrixMulOnce (scExpr M, scExpr B) {
+    // Emit code for M = M * B.  Unlike emitMatrixMul, this emits no
+    // profile marks, so it may go inside a CUFor loop.
+    // M and B must be different names:  the skew shifts each of them
+    // where it is, so squaring in place would mix the two skews.  To
+    // square a matrix, copy it first.
+    scExpr As[1];
+    scExpr Bs[1];
+    As[0] = M;
+    Bs[0] = B;
+    if (M == B) {
+        printf("emitMatrixMulOnce cannot multiply a matrix by itself.\n");
+        exit(1);
+    }
+    MatrixMulVars v;
+    emitMatrixMulStart(&v, As, Bs, 1);
+    emitMatrixMulSkew(&v);
+    emitMatrixMulLoop(&v);
+    emitMatrixMulEnd(&v);
+} // End emitMatrixMulOnce.
+
+void emitMatrixPower (scExpr M, scExpr P, int k) {
+    // Emit code for P = M^k, for M and P in ape memory and k >= 0.  M is
+    // left as it was.  Everything stays in the apes, so only P need be
+    // copied out at the end.
+    // This code uses CU register 11 (cuR11), destroying what was in it.
+    int bit, run, scope;
+    scExpr square;
+
+    if (k == 0) {
+        // The identity matrix.
+        Set(P, a0);
+        ApeIf(Eq(onDiagonal, IntConst(1)));
+        Set(P, a1);
+        ApeFi();
+        return;
+    }
+
+    // Repeated squaring, from the highest bit of k down.  P starts as M,
+    // for the highest bit, and each lower bit squares P, then multiplies
+    // by M again if the bit is 1.  So a k of 2^m takes m squarings rather
+    // than k-1 multiplies.
+    //
+    // The bits of k are known now, so rather than emitting a multiply for
+    // every step, each run of equal bits is one CUFor around the steps for
+    // one bit.  The kernel then holds one or two multiplies per run of
+    // bits, not per bit.
+    //
+    // Each squaring multiplies P by a copy of itself, square, since the
+    // two operands of a multiply must be different.
+    scope = apeScopeBegin();
+    square = apeTemp(Approx);
+    Set(P, M);
+    bit = 30;
+    while (((k >> bit) & 1) == 0) bit--;
+    bit--;
+    while (bit >= 0) {
+        int one = (k >> bit) & 1;
+        run = 0;
+        while (bit >= 0 && ((k >> bit) & 1) == one) {
+            run++;
+            bit--;
+        }
+        if (run > 1) {
+            CUFor(cuR11, IntConst(0), IntConst(run-1), IntConst(1));
+        }
+        Set(square, P);
+        emitMatrixMulOnce(P, square);
+        if (one) emitMatrixMulOnce(P, M);
+        if (run > 1) {
+            CUForEnd();
+        }
+    }
+    apeScopeEnd(scope);
+} // End emitMatrixPower.
@@ -0,0 +1,44 @@
+void emitMatrixVectorMul (scExpr M, int cuAddressX, int cuAddressY) {
+    // Emit code for y = M * x, where M is an NxN matrix in ape memory, and
+    // x and y are vectors of N words in CU Data Memory, at cuAddressX and
+    // cuAddressY.  Only x and y cross between the CU and the apes, and the
+    // apes do log2(N) rounds of work rather than the N steps of
+    // emitMatrixMul.  The rounds make no fewer gets (see
+    // emitGetTorusHops), but there is one multiply, not N.
+    // This code destroys the contents of X and Y in ape memory, and uses
+    // mask mode.
+    int hops;
+    int row0 = 0;
+    int scope = apeScopeBegin();
+
+    // Copy x into the top row of apes, so x[j] is in ape [0, j].
+    emitCopyRowsFromCUToApes(cuAddressX, MemAddress(X), &row0, 1);
+
+    // Broadcast x down the columns, doubling the rows that have it each
+    // round:  after the round that fetches from hops rows North, rows 0
+    // to 2*hops-1 have x.  Rows that already have it are masked off, and
+    // rows further down take whatever arrives, which a later round
+    // replaces.
+    scExpr xAll = apeTemp(Approx);
+    scExpr xNorth = apeTemp(Approx);
+    Set(xAll, X);
+    for (hops = 1; hops < N; hops *= 2) {
+        Set(xNorth, xAll);
+        emitGetTorusHops(xNorth, getNorth, hops);
+        ApeIf(Gt(apeRowNum, IntConst(hops-1)));
+        Set(xAll, xNorth);
+        ApeFi();
+    }
+
+    // Multiply element-wise, so that ape [i, j] has M[i][j] * x[j], and
+    // sum each row into its left column.
+    scExpr sum = apeTemp(Approx);
+    Set(sum, Mul(M, xAll));
+    emitReduceRows(sum, reduceSum);
+
+    // Column 0 now holds y.  Copy just that column out.
+    Set(Y, sum);
+    emitCopyColumnFromApesToCU(MemAddress(Y), 0, cuAddressY);
+    apeScopeEnd(scope);
+
+} // End emitMatrixVectorMul.
@@ -0,0 +1,147 @@
+// Reductions over the ape grid.  Each one works in log2(N) rounds, like
+// the skew in emitMatrixMulSkew:  in the round that fetches from hops
+// apes away along a row (or column), every ape combines its value with
+// the one hops further along, so after the round it holds the result for
+// the 2*hops apes starting at itself.  Apes whose span already reaches
+// the end of the row combine with a value that changes nothing instead,
+// so no value is counted twice, and the wrap around the torus brings in
+// nothing.  The result ends up in the first ape of each row (column 0),
+// of each column (row 0), or of the grid (ape [0, 0]), and only that
+// needs to be read back.
+//
+// The rounds save combining, not gets (see emitGetTorusHops):  log2(N)
+// adds or compares rather than N-1.
+//
+// The value being reduced must be in an ape variable, since torus gets
+// don't work on ape memory names, and it is destroyed.  The reductions
+// use mask mode.
+
+// The ways of combining values.  reduceArgMax is reduceMax, and also
+// keeps the row and column number of the maximum, the first one in row
+// major order if there is a tie.
+enum { reduceSum, reduceMax, reduceMin, reduceArgMax };
+
+void emitReduceLine (scExpr x, int op, int dir, scExpr rowAt, scExpr colAt){
+    // Emit one reduction of x along every row (dir is getEast) or every
+    // column (dir is getSouth) of the grid.  For reduceArgMax, rowAt and
+    // colAt are ape variables holding the row and column number of each
+    // ape's x, and are kept with it; otherwise they are not used.
+    scExpr position = (dir == getEast ? apeColNum : apeRowNum);
+    int hops;
+
+    // The row and column that travel with other are only needed for
+    // reduceArgMax.
+    int scope = apeScopeBegin();
+    scExpr other = apeTemp(Approx);
+    scExpr otherRow = _;
+    scExpr otherCol = _;
+    if (op == reduceArgMax) {
+        otherRow = apeTemp(Int);
+        otherCol = apeTemp(Int);
+    }
+    for (hops = 1; hops < N; hops *= 2) {
+        Set(other, x);
+        emitGetTorusHops(other, dir, hops);
+        if (op == reduceArgMax) {
+            Set(otherRow, rowAt);
+            Set(otherCol, colAt);
+            emitGetTorusHops(otherRow, dir, hops);
+            emitGetTorusHops(otherCol, dir, hops);
+        }
+
+        // Apes within hops of the end of the line have nothing more to
+        // take:  for a sum they add zero, otherwise they compare x with
+        // itself.
+        ApeIf(Gt(position, IntConst(N-1-hops)));
+        Set(other, op == reduceSum ? a0 : x);
+        ApeFi();
+
+        // The value fetched comes from further along the line, so a strict
+        // comparison keeps the earlier position when they tie.
+        if (op == reduceSum) {
+            Set(x, Add(x, other));
+        } else if (op == reduceMin) {
+            ApeIf(Gt(x, other));
+            Set(x, other);
+            ApeFi();
+        } else {
+            ApeIf(Gt(other, x));
+            Set(x, other);
+            if (op == reduceArgMax) {
+                Set(rowAt, otherRow);
+                Set(colAt, otherCol);
+            }
+            ApeFi();
+        }
+    }
+    apeScopeEnd(scope);
+}
+
+void emitReduceRows (scExpr x, int op){
+    // Emit code that reduces x along each row, leaving the result for row
+    // i in ape [i, 0].  op is reduceSum, reduceMax or reduceMin.
+    emitReduceLine(x, op, getEast, _, _);
+}
+
+void emitReduceColumns (scExpr x, int op){
+    // Emit code that reduces x along each column, leaving the result for
+    // column j in ape [0, j].  op is reduceSum, reduceMax or reduceMin.
+    emitReduceLine(x, op, getSouth, _, _);
+}
+
+void emitReduceGrid (scExpr x, int op){
+    // Emit code that reduces x over the whole grid, leaving the result in
+    // ape [0, 0].  op is reduceSum, reduceMax or reduceMin.
+    emitReduceLine(x, op, getEast, _, _);
+    emitReduceLine(x, op, getSouth, _, _);
+}
+
+void emitArgMaxGrid (scExpr x, scExpr rowAt, scExpr colAt){
+    // Emit code that finds the maximum of x over the whole grid, leaving
+    // it in ape [0, 0], and its row and column number in the ape
+    // variables rowAt and colAt of ape [0, 0].
+    Set(rowAt, apeRowNum);
+    Set(colAt, apeColNum);
+    emitReduceLine(x, reduceArgMax, getEast, rowAt, colAt);
+    emitReduceLine(x, reduceArgMax, getSouth, rowAt, colAt);
+}
+
+void emitCopyApeToCU (int apeAddress, int row, int col, int cuAddress){
+    // Copies the one 16 bit data word in Ape[row, col]Mem[apeAddress] to
+    // CU Data Memory at cuAddress.
+    // This code uses ape register zero (apeR0), destroying what was in it.
+    eControl(controlOpReserveApeReg,apeR0);
+    eApeC(apeLoad, apeR0, _, apeAddress);
+    eCUX(cuSetRWAddress, _, _, cuAddress);
+    eCUC(cuSet, cuRChipRow, _, row / apeRows);
+    eCUC(cuSet, cuRChipCol, _, col / apeCols);
+    eCUC(cuSet, cuRApeRow, _, row % apeRows);
+    eCUC(cuSet, cuRApeCol, _, col % apeCols);
+    eCUC(cuRead, _, rwIgnoreMasks|rwUseCUMemory, (propDelay<<8)|apeR0);
+    eControl(controlOpReleaseApeReg,apeR0);
+}
+
+void emitReduceToCU (scExpr M, int op, int cuAddress){
+    // Emit code that reduces the matrix M in ape memory over the whole
+    // grid, and copies the one word of the result to CU Data Memory at
+    // cuAddress.  op is reduceSum, reduceMax or reduceMin.  For
+    // reduceArgMax, the row and column number of the maximum follow it,
+    // at cuAddress+1 and cuAddress+2.
+    int scope = apeScopeBegin();
+    scExpr x = apeTemp(Approx);
+    Set(x, M);
+    if (op == reduceArgMax) {
+        scExpr rowAt = apeTemp(Int);
+        scExpr colAt = apeTemp(Int);
+        emitArgMaxGrid(x, rowAt, colAt);
+        Set(reduceRow, rowAt);
+        Set(reduceCol, colAt);
+        emitCopyApeToCU(MemAddress(reduceRow), 0, 0, cuAddress+1);
+        emitCopyApeToCU(MemAddress(reduceCol), 0, 0, cuAddress+2);
+    } else {
+        emitReduceGrid(x, op);
+    }
+    Set(reduceValue, x);
+    emitCopyApeToCU(MemAddress(reduceValue), 0, 0, cuAddress);
+    apeScopeEnd(scope);
+}
@@ -0,0 +1,60 @@
+void emitStreamStep (int cuAddressB, int cuAddressC) {
+    // Emit one step of emitStreamMatrixMul:  copy B from the CU at
+    // cuAddressB, multiply, and copy C = R * B to the CU at cuAddressC.
+    // Then send the signal to the CPU and wait for it to say to continue.
+    emitCopyMatrixFromCUToApes(cuAddressB, MemAddress(B));
+
+    // A = R * B.  The next step copies in a new B, so this one need not
+    // be put back.
+    Set(A, Aresident);
+    emitMatrixMulLean(&A, &B, 1, 0);
+
+    emitCopyMatrixFromApesToCU(MemAddress(A), cuAddressC);
+    emitSignalCPU();
+} // End emitStreamStep.
+
+void emitStreamMatrixMul (int count, int cuAddressR,
+                          int cuAddressB0, int cuAddressB1,
+                          int cuAddressC0, int cuAddressC1) {
+    // Emit code that multiplies one resident matrix R by a stream of count
+    // B matrices:  C = R * B, for each B in turn.  R is copied once, from
+    // CU Data Memory at cuAddressR, into the ape memory name Aresident.
+    //
+    // The B matrices ping-pong between two CU Data Memory buffers, at
+    // cuAddressB0 and cuAddressB1, and so do the results, at cuAddressC0
+    // and cuAddressC1.  Step i uses buffer i%2.  At the end of step i the
+    // S1 sends the signal and waits for the CPU to clear it.  The CPU
+    // must put B number 0 in buffer 0 before the stream starts, and before
+    // clearing the signal for step i it must put B number i+1 in buffer
+    // (i+1)%2.  While the S1 works on step i, that buffer is not in use,
+    // so the CPU converts and copies the next B while the apes multiply,
+    // instead of the apes waiting for every copy.  The CPU can also read
+    // result i from buffer i%2 after clearing the signal, because the S1
+    // doesn't write that buffer again until step i+2.
+    //
+    // The steps are emitted as one pair, buffer 0 then buffer 1, inside a
+    // CUFor over count/2 trips, with one more step after it if count is
+    // odd.  So the kernel is the same size however long the stream is.
+    // The signals are inside a CUFor, where profile marks can't go, so
+    // this can't be emitted with profiling on.
+    //
+    // This code destroys the contents of A and B in ape memory, and uses
+    // CU register 10 (cuR10), destroying what was in it.
+
+    if (profiling) {
+        printf("emitStreamMatrixMul can't be emitted with profiling on.\n");
+        exit(1);
+    }
+
+    emitCopyMatrixFromCUToApes(cuAddressR, MemAddress(Aresident));
+
+    if (count/2 > 0) {
+        CUFor(cuR10, IntConst(0), IntConst(count/2 - 1), IntConst(1));
+        emitStreamStep(cuAddressB0, cuAddressC0);
+        emitStreamStep(cuAddressB1, cuAddressC1);
+        CUForEnd();
+    }
+    if (count%2 == 1) {
+        emitStreamStep(cuAddressB0, cuAddressC0);
+    }
+} // End emitStreamMatrixMul.
@@ -0,0 +1,116 @@
+void emitTiledMatrixMul (int m, int k, int p, int cuAddressAB,
+                         int cuAddressC) {
+    // Emit code for a tiled matrix multiply:  C = A * B, where A is m x k,
+    // B is k x p, and C is m x p.  The matrices can be larger than the
+    // NxN ape grid, and need not fit in CU Data Memory:  the CPU streams
+    // them in a pair of tiles at a time, with serveTiledMatrixMul.
+    //
+    // Each tile of C is the sum over i of (tile i of its row of A) *
+    // (tile i of its column of B).  Each of those tile products is an
+    // ordinary NxN multiply on the ape grid, which emitMatrixMulLean does
+    // in the ape memory names A and B.  B is copied in again for the next
+    // product, so the multiply leaves it skewed rather than putting it
+    // back.  The running sum of the products is kept in the ape memory
+    // name C, so it never leaves the apes until the tile of C is finished.
+    //
+    // The tile products are a CUFor inside a CUFor over the tiles of C, so
+    // the kernel is the same size however big the matrices are.  Each
+    // trip copies the pair of tiles the CPU has put at cuAddressAB, the
+    // tile of A followed by the tile of B, into the apes, and signals the
+    // CPU, which puts the next pair in its place while the apes multiply.
+    // Each finished tile of C goes to cuAddressC, with another signal, for
+    // the CPU to read.  So only three tiles of CU Data Memory are used.
+    //
+    // Tiles are NxN, the size of the ape grid, so the grid must have as
+    // many ape rows as ape columns.  A grid such as 48x44 is not supported.
+    //
+    // The signals are inside CUFor loops, where profile marks can't go,
+    // so this can't be emitted with profiling on.
+    //
+    // This code destroys the contents of A, B and C in ape memory, and
+    // uses CU registers 10 and 11 (cuR10 and cuR11), destroying what was
+    // in them.
+
+    int tilesOfC = numTiles(m) * numTiles(p);
+    int tilesOfK = numTiles(k);
+
+    if (profiling) {
+        printf("emitTiledMatrixMul can't be emitted with profiling on.\n");
+        exit(1);
+    }
+
+    CUFor(cuR10, IntConst(0), IntConst(tilesOfC-1), IntConst(1));
+    Set(C, a0);
+    CUFor(cuR11, IntConst(0), IntConst(tilesOfK-1), IntConst(1));
+
+    // Copy the pair of tiles from the CU to the apes, and let the CPU
+    // put the next pair in its place.
+    emitCopyMatrixFromCUToApes(cuAddressAB, MemAddress(A));
+    emitCopyMatrixFromCUToApes(cuAddressAB + N*N, MemAddress(B));
+    emitSignalCPU();
+
+    // A = A * B, added to the running sum.
+    emitMatrixMulLean(&A, &B, 1, 0);
+    Set(C, Add(C, A));
+    CUForEnd();
+
+    // The tile of C is finished, so copy it back to the CU.
+    emitCopyMatrixFromApesToCU(MemAddress(C), cuAddressC);
+    emitSignalCPU();
+    CUForEnd();
+
+} // End emitTiledMatrixMul.
+
+void cvtTiledPair (float *floatA, float *floatB, int m, int k, int p,
+                   int pair) {
+    // Converts pair number pair of a tiled multiply into approxTiles, the
+    // tile of A followed by the tile of B.  Pair number pair is product
+    // number pair % numTiles(k) of tile number pair / numTiles(k) of C,
+    // counting the tiles of C in row major order.
+    int tilesOfK = numTiles(k);
+    int tile = pair / tilesOfK;
+    int i = pair % tilesOfK;
+    int tileRow = tile / numTiles(p);
+    int tileCol = tile % numTiles(p);
+    cvtTile(floatA, m, k, tileRow, i, (scApprox *)approxTiles);
+    cvtTile(floatB, k, p, i, tileCol, (scApprox *)approxTiles + N*N);
+} // End cvtTiledPair.
+
+void serveTiledMatrixMul (float *floatA, float *floatB, float *floatC,
+                          int m, int k, int p, int cuAddressAB,
+                          int cuAddressC) {
+    // The CPU side of emitTiledMatrixMul, with the same arguments, and
+    // the matrices in float format, in row major order.  Call it while the
+    // S1 waits at the signal before the multiply.  Puts the first pair of
+    // tiles in the CU and lets the S1 go on, then answers each signal of
+    // the multiply in turn.  Returns once the last tile of C is in floatC,
+    // with the S1 waiting at its signal, for the caller to clear.
+    int tilesOfK = numTiles(k);
+    int pairs = numTiles(m) * numTiles(p) * tilesOfK;
+    int pair;
+
+    cvtTiledPair(floatA, floatB, m, k, p, 0);
+    scWriteCUDataMemoryBlock(2*2*N*N, (uintptr_t)approxTiles, cuAddressAB);
+    scClearCUSignal();
+
+    for (pair=0; pair<pairs; pair++) {
+        // Convert the next pair while the S1 copies in this one, and put
+        // it in the CU once this one is in the apes.
+        if (pair+1 < pairs) cvtTiledPair(floatA, floatB, m, k, p, pair+1);
+        waitSignalCPU();
+        if (pair+1 < pairs) {
+            scWriteCUDataMemoryBlock(2*2*N*N, (uintptr_t)approxTiles,
+                                     cuAddressAB);
+        }
+        scClearCUSignal();
+
+        // After the last product of a tile of C, read it back.
+        if (pair % tilesOfK == tilesOfK-1) {
+            int tile = pair / tilesOfK;
+            waitSignalCPU();
+            copyTileFromCU(floatC, m, p, tile / numTiles(p),
+                           tile % numTiles(p), cuAddressC);
+            if (pair+1 < pairs) scClearCUSignal();
+        }
+    }
+} // End serveTiledMatrixMul.
@@ -0,0 +1,180 @@
+// Matrix multiply on the CPU, to compute the correct results that the
+// S1's results are checked against.  It is blocked so that the pieces of
+// the matrices being worked on stay in cache, and it splits the rows of
+// the result between one thread per CPU core, so that checking even a
+// 4096x4096 product takes seconds.
+
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Block sizes, in rows and columns of floats.  A block of B (HOST_KB x
+// HOST_JB) fits in a core's L2 cache, and the rows of C being updated
+// (HOST_IB x HOST_JB) fit alongside it.  HOST_IB must be a multiple of 4.
+#define HOST_IB 32
+#define HOST_KB 128
+#define HOST_JB 512
+
+// One thread's share of a host matrix multiply.
+typedef struct {
+    const float *a;
+    const float *b;
+    float *c;
+    int k;
+    int p;
+    int rowStart;   // The thread computes rows rowStart..rowEnd-1 of c.
+    int rowEnd;
+} HostMatrixMulJob;
+
+void hostAxpy (float *c, const float *b, float a, int n) {
+    // c[0..n-1] += a * b[0..n-1].
+    int j = 0;
+#ifdef __SSE2__
+    __m128 a4 = _mm_set1_ps(a);
+    for (; j + 4 <= n; j += 4) {
+        _mm_storeu_ps(c + j, _mm_add_ps(_mm_loadu_ps(c + j),
+                                        _mm_mul_ps(a4, _mm_loadu_ps(b + j))));
+    }
+#endif
+    for (; j < n; j++) {
+        c[j] += a * b[j];
+    }
+}
+
+void hostMulAdd4x8 (float *c, const float *a, const float *b,
+                    int k, int p, int kStart, int kEnd) {
+    // Adds a[0..3][kStart..kEnd-1] * b[kStart..kEnd-1][0..7] to
+    // c[0..3][0..7], where a has rows of length k and b and c have rows of
+    // length p.  The 4x8 piece of c stays in registers for the whole sum,
+    // so each element of b that is loaded is used four times.
+    int kb, r;
+#ifdef __SSE2__
+    __m128 c0l = _mm_loadu_ps(c), c0h = _mm_loadu_ps(c + 4);
+    __m128 c1l = _mm_loadu_ps(c + p), c1h = _mm_loadu_ps(c + p + 4);
+    __m128 c2l = _mm_loadu_ps(c + 2*p), c2h = _mm_loadu_ps(c + 2*p + 4);
+    __m128 c3l = _mm_loadu_ps(c + 3*p), c3h = _mm_loadu_ps(c + 3*p + 4);
+    for (kb = kStart; kb < kEnd; kb++) {
+        __m128 bl = _mm_loadu_ps(b + (size_t)kb*p);
+        __m128 bh = _mm_loadu_ps(b + (size_t)kb*p + 4);
+        __m128 a0 = _mm_set1_ps(a[kb]);
+        __m128 a1 = _mm_set1_ps(a[k + kb]);
+        __m128 a2 = _mm_set1_ps(a[2*k + kb]);
+        __m128 a3 = _mm_set1_ps(a[3*k + kb]);
+        c0l = _mm_add_ps(c0l, _mm_mul_ps(a0, bl));
+        c0h = _mm_add_ps(c0h, _mm_mul_ps(a0, bh));
+        c1l = _mm_add_ps(c1l, _mm_mul_ps(a1, bl));
+        c1h = _mm_add_ps(c1h, _mm_mul_ps(a1, bh));
+        c2l = _mm_add_ps(c2l, _mm_mul_ps(a2, bl));
+        c2h = _mm_add_ps(c2h, _mm_mul_ps(a2, bh));
+        c3l = _mm_add_ps(c3l, _mm_mul_ps(a3, bl));
+        c3h = _mm_add_ps(c3h, _mm_mul_ps(a3, bh));
+    }
+    _mm_storeu_ps(c, c0l);
+    _mm_storeu_ps(c + 4, c0h);
+    _mm_storeu_ps(c + p, c1l);
+    _mm_storeu_ps(c + p + 4, c1h);
+    _mm_storeu_ps(c + 2*p, c2l);
+    _mm_storeu_ps(c + 2*p + 4, c2h);
+    _mm_storeu_ps(c + 3*p, c3l);
+    _mm_storeu_ps(c + 3*p + 4, c3h);
+    (void)r;
+#else
+    for (r = 0; r < 4; r++) {
+        for (kb = kStart; kb < kEnd; kb++) {
+            hostAxpy(c + (size_t)r*p, b + (size_t)kb*p, a[(size_t)r*k + kb],
+                     8);
+        }
+    }
+#endif
+}
+
+void *hostMatrixMulRows (void *arg) {
+    // Computes the rows of c in one thread's share.
+    HostMatrixMulJob *job = arg;
+    int k = job->k;
+    int p = job->p;
+    int ii, kk, jj, i, j, kb;
+
+    for (i = job->rowStart; i < job->rowEnd; i++) {
+        memset(job->c + (size_t)i*p, 0, sizeof(float)*p);
+    }
+    for (ii = job->rowStart; ii < job->rowEnd; ii += HOST_IB) {
+        int iEnd = ii + HOST_IB < job->rowEnd ? ii + HOST_IB : job->rowEnd;
+        for (kk = 0; kk < k; kk += HOST_KB) {
+            int kEnd = kk + HOST_KB < k ? kk + HOST_KB : k;
+            for (jj = 0; jj < p; jj += HOST_JB) {
+                int jEnd = jj + HOST_JB < p ? jj + HOST_JB : p;
+
+                // Four rows at a time, eight columns at a time, and then
+                // whatever is left over at the edges one row at a time.
+                for (i = ii; i + 4 <= iEnd; i += 4) {
+                    for (j = jj; j + 8 <= jEnd; j += 8) {
+                        hostMulAdd4x8(job->c + (size_t)i*p + j,
+                                      job->a + (size_t)i*k, job->b + j,
+                                      k, p, kk, kEnd);
+                    }
+                    if (j < jEnd) {
+                        int r;
+                        for (r = i; r < i + 4; r++) {
+                            for (kb = kk; kb < kEnd; kb++) {
+                                hostAxpy(job->c + (size_t)r*p + j,
+                                         job->b + (size_t)kb*p + j,
+                                         job->a[(size_t)r*k + kb], jEnd - j);
+                            }
+                        }
+                    }
+                }
+                for (; i < iEnd; i++) {
+                    for (kb = kk; kb < kEnd; kb++) {
+                        hostAxpy(job->c + (size_t)i*p + jj,
+                                 job->b + (size_t)kb*p + jj,
+                                 job->a[(size_t)i*k + kb], jEnd - jj);
+                    }
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+void hostMatrixMul (const float *a, const float *b, float *c,
+                    int m, int k, int p) {
+    // c = a * b on the CPU, where a is m x k, b is k x p and c is m x p,
+    // all stored in row major order.
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int blocks = (m + HOST_IB - 1) / HOST_IB;
+    if (threads > blocks) threads = blocks;
+    if (threads < 1) threads = 1;
+
+    HostMatrixMulJob jobs[threads];
+    pthread_t ids[threads];
+    int started[threads];
+    int t;
+    for (t = 0; t < threads; t++) {
+        // Give each thread an equal share of the blocks of rows.
+        jobs[t].a = a;
+        jobs[t].b = b;
+        jobs[t].c = c;
+        jobs[t].k = k;
+        jobs[t].p = p;
+        jobs[t].rowStart = (blocks*t/threads)*HOST_IB;
+        jobs[t].rowEnd = (blocks*(t+1)/threads)*HOST_IB;
+        if (jobs[t].rowEnd > m) jobs[t].rowEnd = m;
+    }
+
+    // The first share runs on this thread, the others on new threads.
+    for (t = 1; t < threads; t++) {
+        started[t] = pthread_create(&ids[t], NULL, hostMatrixMulRows,
+                                    &jobs[t]) == 0;
+        if (!started[t]) {
+            // Couldn't start a thread, so do its share here.
+            hostMatrixMulRows(&jobs[t]);
+        }
+    }
+    hostMatrixMulRows(&jobs[0]);
+    for (t = 1; t < threads; t++) {
+        if (started[t]) pthread_join(ids[t], NULL);
+    }
+}
@@ -0,0 +1,141 @@
+// Starting and stopping machines, and running several at once.
+//
+// The Singular libraries keep the machine they drive, and the kernel
+// being emitted, in globals of their own, so one process can only drive
+// one machine at a time.  So the description of a machine is kept in a
+// Machine, which startMachine makes current, and runMachines drives
+// several machines in parallel by giving each one a process of its own.
+//
+// A Machine is only that description, not a context for driving the
+// machine.  The staging buffers (floatA, floatB, approxM, approxResident
+// and approxTiles), the Nova names from defineNames, propDelay and the
+// pool of temporaries all stay globals, as does llKernel, which belongs
+// to the libraries.  They serve whatever machine is current.
+// Each process of runMachines has its own copy of them, which is what
+// keeps the machines apart.  Moving them into a Machine would not let
+// one process drive two machines, since the libraries would still
+// allow only one.
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+typedef struct {
+    int emulated;      // 1 for an emulated machine, 0 for real S1 hardware.
+    int chipRows;      // Chips down and across the machine.
+    int chipCols;
+    int apeRows;       // Apes down and across each chip.
+    int apeCols;
+    int traceFlags;
+} Machine;
+
+void startMachine (Machine *m) {
+    // Initializes the machine m, ready to emit kernels for it, and makes
+    // it the one the emitters and copies work on.
+
+    // The emitters and copies read the size of the machine from globals.
+    emulated = m->emulated;
+    chipRows = m->chipRows;
+    chipCols = m->chipCols;
+    apeRows = m->apeRows;
+    apeCols = m->apeCols;
+    traceFlags = m->traceFlags;
+
+    // Initializes a machine that is either emulated or real, has
+    // chipRows x chipCols chips, has apeRows x apeCols apes within each
+    // chip, uses the trace flags given, DDR (HELP?), randomize(HELP?),
+    // and is a torus.
+    scInitializeMachine ((emulated ? scEmulated : scRealMachine),
+                         chipRows, chipCols, apeRows, apeCols,
+                         traceFlags, 0 /* DDR */, 0 /* randomize */,
+                         1 /* torus */);
+
+    // Exit if S1 is still running.
+    // (scInitializeMachine is supposed to completely reset the machine,
+    // so this should not be able to happen, but current CU has a bug.)
+    if (scReadCURunning() != 0) {
+        printf("S1 is RUNNING AFTER RESET.  Terminating execution.\n");
+        exit(1);
+    }
+
+    // Initializes the kernel creating code.
+    scKernelInit();
+    scEmitLLKernelCreate();
+
+    // Defines some Nova names, which also emits the code that computes
+    // the ape coordinates.
+    defineNames();
+
+    // Measures how long reads from the apes take on this machine, so the
+    // copies to the CU wait no longer than they need to.  This runs the
+    // first kernel, which computes the ape coordinates too.
+    calibratePropDelay();
+}
+
+void stopMachine () {
+    // Terminates the current machine.
+    scTerminateMachine();
+}
+
+int runMachines (Machine machines[], int count, int jobs,
+                 void (*work)(Machine *)) {
+    // Starts each of the count machines, calls work on it, and stops it
+    // again, running up to jobs machines at once.  Each machine runs in a
+    // child process, with its output saved and printed in the order of
+    // machines, so the output is the same as running them one by one.
+    // Real machines are run one by one, in this process, since they share
+    // the one S1.  Returns the number of machines that failed.
+    int first, k, failures = 0;
+
+    for (k = 0; k < count; k++) {
+        if (!machines[k].emulated) jobs = 1;
+    }
+    if (jobs <= 1) {
+        for (k = 0; k < count; k++) {
+            startMachine(&machines[k]);
+            work(&machines[k]);
+            stopMachine();
+        }
+        return 0;
+    }
+
+    FILE *output[count];
+    pid_t child[count];
+    for (first = 0; first < count; first += jobs) {
+        int last = first + jobs < count ? first + jobs : count;
+
+        // Anything not yet printed would be printed again by each child.
+        fflush(stdout);
+        for (k = first; k < last; k++) {
+            output[k] = tmpfile();
+            child[k] = output[k] == NULL ? -1 : fork();
+            if (child[k] < 0) {
+                printf("Could not start a process for machine %d.\n", k);
+                exit(1);
+            }
+            if (child[k] == 0) {
+                dup2(fileno(output[k]), fileno(stdout));
+                startMachine(&machines[k]);
+                work(&machines[k]);
+                stopMachine();
+                fflush(stdout);
+                _exit(0);
+            }
+        }
+
+        // Print each machine's output once it is done, in order.
+        for (k = first; k < last; k++) {
+            int status;
+            char buffer[4096];
+            size_t n;
+            waitpid(child[k], &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failures++;
+            rewind(output[k]);
+            while ((n = fread(buffer, 1, sizeof(buffer), output[k])) > 0) {
+                fwrite(buffer, 1, n, stdout);
+            }
+            fclose(output[k]);
+        }
+    }
+    fflush(stdout);
+    return failures;
+}
@@ -0,0 +1,121 @@
+// Asynchronous kernels, and a mailbox ring for their results.
+//
+// kernelSubmit ends the kernel being emitted and queues it, and
+// kernelPoll starts the next queued kernel once the S1 has halted, so the
+// host never waits for a kernel to be loaded or to finish.
+//
+// Rather than signaling the CPU for every result, and waiting for it to
+// clear the signal, a kernel posts each result to the mailbox:  the S1
+// writes the result's number into the next of MAILBOX_SLOTS words of CU
+// Data Memory, which the CPU can read whenever it likes with mailboxPoll.
+// Results are numbered from 0, and the word holds the number plus one, so
+// that the zeros the ring starts with mean nothing has been posted.
+// Results themselves go wherever the kernel puts them; to keep them until
+// the CPU has read them, a kernel should put result n in buffer
+// n % MAILBOX_SLOTS.  The S1 only stops, with emitSignalCPU, after filling
+// the ring, and the CPU lets it go on, with mailboxRelease, once it has
+// taken every result in the ring; that handshake blocks the CPU briefly,
+// and is the only call here that does.  So the S1 can finish up to
+// MAILBOX_SLOTS results before the CPU has to answer, and the CPU can
+// convert and queue the next work in the meantime.
+
+#define MAILBOX_SLOTS 4
+#define MAX_QUEUED_KERNELS 8
+
+// Where the ring is in CU Data Memory, how many results the emitted
+// kernels post, and how many results the CPU has taken.
+int mailboxAddress;
+int mailboxPosted = 0;
+int mailboxTaken = 0;
+
+// Kernels submitted but not yet started, oldest first.
+LLKernel *kernelQueue[MAX_QUEUED_KERNELS];
+int kernelQueueCount = 0;
+
+void mailboxInit (int cuAddress) {
+    // Puts an empty ring of MAILBOX_SLOTS words at cuAddress in CU Data
+    // Memory.  Call this before submitting the kernels that use it.
+    int i;
+    for (i=0; i<MAILBOX_SLOTS; i++) {
+        ((uint16_t *)approxM)[i] = 0;
+    }
+    scWriteCUDataMemoryBlock(2*MAILBOX_SLOTS, (uintptr_t)approxM, cuAddress);
+    mailboxAddress = cuAddress;
+    mailboxPosted = 0;
+    mailboxTaken = 0;
+}
+
+int emitMailboxPost () {
+    // Emit code that posts the next result to the mailbox.  Returns the
+    // number of the result.
+    int slot = mailboxPosted % MAILBOX_SLOTS;
+    mailboxPosted++;
+    Set(mailboxWord, IntConst(mailboxPosted));
+    emitCopyApeToCU(MemAddress(mailboxWord), 0, 0, mailboxAddress + slot);
+
+    // Once the ring is full, wait for the CPU to empty it.
+    if (mailboxPosted % MAILBOX_SLOTS == 0) emitSignalCPU();
+    return mailboxPosted - 1;
+}
+
+int mailboxPoll () {
+    // Returns the number of the next result if the S1 has posted it, or
+    // -1 if it hasn't yet.  Never waits.  Call mailboxDone once finished
+    // with the result, before polling again.
+    int slot = mailboxTaken % MAILBOX_SLOTS;
+    uint16_t words[4];
+    scReadCUDataMemoryBlock(sizeof(words), (uintptr_t)words,
+                            mailboxAddress + slot);
+    if (words[0] != mailboxTaken + 1) return -1;
+    return mailboxTaken;
+}
+
+int mailboxDone () {
+    // Says the CPU has finished with the result mailboxPoll returned, so
+    // its buffer may be used again.  Never waits.  Returns 1 if that
+    // empties a full ring, so the S1 is waiting for mailboxRelease, and 0
+    // if not.
+    mailboxTaken++;
+    return mailboxTaken % MAILBOX_SLOTS == 0;
+}
+
+void mailboxRelease () {
+    // Lets the S1 go on after it has filled the ring, once mailboxDone has
+    // said the CPU has emptied it.  This is the one call of the mailbox
+    // that waits, since the library has no way to ask whether the S1 has
+    // signaled without waiting for it.  The wait is short, since the S1
+    // signals straight after posting the last result of the ring, which
+    // the CPU has already seen; the CPU can queue more work before calling
+    // this.
+    waitSignalCPU();
+    scClearCUSignal();
+}
+
+void kernelPoll () {
+    // Starts the oldest submitted kernel, if there is one and the S1 has
+    // halted.  Never waits.
+    int i;
+    if (kernelQueueCount == 0 || scReadCURunning() != 0) return;
+    scLLKernelLoad(kernelQueue[0], 0);
+    scLLKernelFree(kernelQueue[0]);
+    scLLKernelExecute(0);
+    kernelQueueCount--;
+    for (i=0; i<kernelQueueCount; i++) {
+        kernelQueue[i] = kernelQueue[i+1];
+    }
+}
+
+void kernelSubmit () {
+    // Ends the kernel being emitted with a halt, queues it to run after
+    // the kernels already submitted, and starts emitting a new kernel.
+    // Starts it straight away if the S1 is free.
+    if (kernelQueueCount == MAX_QUEUED_KERNELS) {
+        printf("More than %d kernels queued.\n", MAX_QUEUED_KERNELS);
+        exit(1);
+    }
+    eCUC(cuHalt, _, _, _);
+    ellNewKernelInstructions();
+    kernelQueue[kernelQueueCount++] = llKernel;
+    scEmitLLKernelCreate();
+    kernelPoll();
+}
@@ -6,8 +6,12 @@ int main (int argc, char *argv[]) {
     int argError = 0;
     int nextArg = 1;
 
-    // There should be three command line arguments, so if argc is less than
-    // or equal to one, there’s been an error.
+    // chips is the number of chip rows and of chip columns the NxN grid
+    // of apes is spread over.  It defaults to a single chip.
+    int chips = 1;
+
+    // There should be three or four command line arguments, so if argc is
+    // less than or equal to one, there’s been an error.
     if (argc<= nextArg) argError = 1;
 
     // Processes whether the machine should be real or emulated.
@@ -32,7 +36,19 @@ int main (int argc, char *argv[]) {
         nextArg += 1;
     }
 
-    // There should only be 3 command line arguments, no more.
+    // The optional fourth command line argument is the number of chip rows
+    // (and chip columns) to spread the ape grid over.  Each chip gets an
+    // equal share of the grid, so it must divide N.
+    if (argc > nextArg) {
+        chips = atoi(argv[nextArg]);
+        nextArg += 1;
+        if (chips < 1 || N % chips != 0) {
+            printf("Chip count must be a positive divisor of %d.\n", N);
+            argError = 1;
+        }
+    }
+
+    // There should only be 4 command line arguments, no more.
     if (argc > nextArg) {
         printf("Too many command line arguments.\n");
         argError = 1;
@@ -46,6 +62,8 @@ int main (int argc, char *argv[]) {
         printf("  <machine>  'real' or 'emulated'\n");
         printf("  <trace>    ‘0’, ‘1’ , ‘2’ , ‘3’ , ‘4’ or ‘5’\n");
         printf("  <trace>    Translate | Emit | API | States | Instructions\n");
+        printf("  [<chips>]  chip rows and columns, a divisor of %d"
+               " (default 1)\n", N);
         exit(1);
     }
 
@@ -53,45 +71,32 @@ int main (int argc, char *argv[]) {
     // to do arithmetic.
     initSingularArithmetic ();
 
-    // Creates a machine with 1 chip.  In the real machine, a chip has 48
-    // ape rows and 44 ape columns.  However, for the sake of making this
-    // code easier, and since we will be running it on an emulated machine,
-    // we can specify that the number of ape rows and columns are equal to
-    // the size of the square matrix we are multiplying.
-    chipRows = 1;
-    chipCols = 1;
-    apeRows = N; // 48 in a real chip.
-    apeCols = N; // 44 in a real chip.
-
-    // Initializes a machine that is either emulated or real, depending
-    // on the command line argument, has 1 chip, has 8x8 apes within each
-    // chip, uses the trace flags in the command line argument, DDR (HELP?),
-    // randomize(HELP?), and is a torus.
-    scInitializeMachine ((emulated ? scEmulated : scRealMachine),
-                         chipRows, chipCols, apeRows, apeCols,
-                         traceFlags, 0 /* DDR */, 0 /* randomize */,
-                         1 /* torus */);
-
-    // Exit if S1 is still running.
-    // (scInitializeMachine is supposed to completely reset the machine,
-    // so this should not be able to happen, but current CU has a bug.)
-    if (scReadCURunning() != 0) {
-        printf("S1 is RUNNING AFTER RESET.  Terminating execution.\n");
-        exit(1);
-    }
-
-    // Initializes the kernel creating code.
-    scKernelInit();
-    scEmitLLKernelCreate();
-
-    // Defines some Nova names.
-    defineNames();
+    // Fill in the table used to convert whole matrices from approx to
+    // float.
+    initCvtArrays ();
+
+    // Creates a machine with chips x chips chips.  In the real machine, a
+    // chip has 48 ape rows and 44 ape columns.  However, for the sake of
+    // making this code easier, and since we will be running it on an
+    // emulated machine, we can specify that the total number of ape rows
+    // and columns across all the chips are equal to the size of the square
+    // matrix we are multiplying.  The torus then wraps around the whole
+    // grid of chips, so the shifts in emitMatrixMul move values from chip
+    // to chip without any change to the multiply itself.
+    Machine machine;
+    machine.emulated = emulated;
+    machine.chipRows = chips;
+    machine.chipCols = chips;
+    machine.apeRows = N / chips; // 48 in a real chip.
+    machine.apeCols = N / chips; // 44 in a real chip.
+    machine.traceFlags = traceFlags;
+    startMachine(&machine);
 
     // Runs the tests.
     tests();
 
     // Terminates the machine.
-    scTerminateMachine();
+    stopMachine();
 
     return 0;
 }
@@ -0,0 +1,220 @@
+// Profiling of regions of emitted kernel code.
+//
+// Emit code brackets a region with ProfileBegin("name") and ProfileEnd().
+// When profiling is on, each of these emits a signal to the CPU and waits
+// for the CPU to clear it.  The CPU side, waitSignalCPU, notes the cycle
+// count (scTotalCyclesTaken, on the emulator) and the wall time at each
+// mark, and lets the kernel go on.  profileReport then prints, for each
+// region, the cycles and seconds spent inside it.
+//
+// scTotalCyclesTaken is documented as the cycle count of the last kernel
+// to finish, and nothing says it is kept up to date while a kernel waits
+// at a signal.  If it isn't, every region sees the same count at both of
+// its marks, so profileReport leaves the cycles empty when every region
+// took 0 cycles, rather than report 0.  Then, for cycle counts, run each
+// region as a kernel of its own, as the benchmark does for the phases of
+// the multiply, and read scTotalCyclesTaken once it has halted.
+//
+// Each region's cycles and seconds include one pair of marks' handshakes
+// with the CPU.  Profiling an empty region measures what a pair costs, to
+// take off the others; a region not much longer than that is too short
+// to measure this way.
+//
+// The CPU has to know which signals are profile marks and which are the
+// kernel's own handshakes, so kernels that profile must send their own
+// signals with emitSignalCPU and wait for them with waitSignalCPU, and
+// must not put profile marks inside a CUFor loop.  With profiling off,
+// ProfileBegin and ProfileEnd emit nothing, and the kernel is unchanged.
+
+#define MAX_PROFILE_EVENTS 1024
+#define MAX_PROFILE_REGIONS 64
+#define MAX_PROFILE_DEPTH 16
+
+// 1 to emit profile marks, 0 to ignore ProfileBegin and ProfileEnd.
+int profiling = 0;
+
+// The kinds of signals a kernel sends the CPU.
+enum { profileUser, profileBegin, profileEnd };
+
+// The signals the kernels emitted so far will send, in order.  The CPU
+// side has handled the first profileNextEvent of them.
+typedef struct {
+    int kind;     // profileUser, profileBegin or profileEnd.
+    int region;   // Index in profileRegions, for profileBegin and profileEnd.
+} ProfileEvent;
+ProfileEvent profileEvents[MAX_PROFILE_EVENTS];
+int profileEventCount = 0;
+int profileNextEvent = 0;
+
+// What has been measured for each region, by name.
+typedef struct {
+    char *name;
+    long cycles;
+    double seconds;
+} ProfileRegion;
+ProfileRegion profileRegions[MAX_PROFILE_REGIONS];
+int profileRegionCount = 0;
+
+// The regions open at this point of the emitted code.
+int profileEmitStack[MAX_PROFILE_DEPTH];
+int profileEmitDepth = 0;
+
+// The cycle count and time at which each region open in the running
+// kernel began.
+int profileStartCycles[MAX_PROFILE_DEPTH];
+double profileStartSeconds[MAX_PROFILE_DEPTH];
+int profileRunDepth = 0;
+
+void profileAddEvent (int kind, int region) {
+    // Records that the kernel being emitted will send a signal of the
+    // given kind here.
+    if (profileEventCount == MAX_PROFILE_EVENTS) {
+        printf("More than %d profiled signals.\n", MAX_PROFILE_EVENTS);
+        exit(1);
+    }
+    profileEvents[profileEventCount].kind = kind;
+    profileEvents[profileEventCount].region = region;
+    profileEventCount++;
+}
+
+void ProfileBegin (char *name) {
+    // Emit the start of a profiled region called name.
+    if (!profiling) return;
+
+    int region;
+    for (region = 0; region < profileRegionCount; region++) {
+        if (strcmp(profileRegions[region].name, name) == 0) break;
+    }
+    if (region == profileRegionCount) {
+        if (region == MAX_PROFILE_REGIONS) {
+            printf("More than %d profiled regions.\n", MAX_PROFILE_REGIONS);
+            exit(1);
+        }
+        profileRegions[region].name = name;
+        profileRegions[region].cycles = 0;
+        profileRegions[region].seconds = 0;
+        profileRegionCount++;
+    }
+    if (profileEmitDepth == MAX_PROFILE_DEPTH) {
+        printf("Profiled regions nested more than %d deep.\n",
+               MAX_PROFILE_DEPTH);
+        exit(1);
+    }
+    profileEmitStack[profileEmitDepth++] = region;
+
+    profileAddEvent(profileBegin, region);
+    eCUC(cuSetSignal, _, _, _);
+    eCUC(cuWaitForClearSignal, _, _, _);
+}
+
+void ProfileEnd () {
+    // Emit the end of the innermost open profiled region.
+    if (!profiling) return;
+
+    if (profileEmitDepth == 0) {
+        printf("ProfileEnd without ProfileBegin.\n");
+        exit(1);
+    }
+    profileAddEvent(profileEnd, profileEmitStack[--profileEmitDepth]);
+    eCUC(cuSetSignal, _, _, _);
+    eCUC(cuWaitForClearSignal, _, _, _);
+}
+
+void emitSignalCPU () {
+    // Emit code to send signal to CPU and wait for it to say to continue.
+    if (profiling) profileAddEvent(profileUser, 0);
+    eCUC(cuSetSignal, _, _, _);
+    eCUC(cuWaitForClearSignal, _, _, _);
+}
+
+int waitProfileMark () {
+    // Waits for the kernel's next signal.  If it is a profile mark,
+    // measures it, lets the kernel continue and returns 1.  Otherwise it is
+    // the caller's own signal, which is left for the caller to clear, and
+    // this returns 0.
+    scLLKernelWaitSignal();
+    if (!profiling || profileNextEvent == profileEventCount) return 0;
+
+    ProfileEvent *e = &profileEvents[profileNextEvent++];
+    if (e->kind == profileUser) return 0;
+
+    int cycles = emulated ? scTotalCyclesTaken : 0;
+    double now = wallSeconds();
+    if (e->kind == profileBegin) {
+        profileStartCycles[profileRunDepth] = cycles;
+        profileStartSeconds[profileRunDepth] = now;
+        profileRunDepth++;
+    } else {
+        profileRunDepth--;
+        ProfileRegion *r = &profileRegions[e->region];
+        r->cycles += cycles - profileStartCycles[profileRunDepth];
+        r->seconds += now - profileStartSeconds[profileRunDepth];
+    }
+    scClearCUSignal();
+    return 1;
+}
+
+void waitSignalCPU () {
+    // Waits for the kernel to send a signal with emitSignalCPU, measuring
+    // any profile marks it passes on the way.  Use this in place of
+    // scLLKernelWaitSignal.
+    while (waitProfileMark()) {
+    }
+}
+
+// How long, in seconds, the CPU waits for the S1 to halt, or for a
+// result it polls for, before giving up on the test.  The tests take a
+// few seconds on the emulator, so only a kernel that is stuck, or an
+// emulator that does not run while the CPU polls, gets this far.
+#define WAIT_LIMIT_SECONDS 60
+
+void waitHalt (char *testname) {
+    // Waits for the kernel to halt.  If it hasn't after
+    // WAIT_LIMIT_SECONDS, prints an error naming testname and exits,
+    // since nothing after it can run.
+    double start = wallSeconds();
+    while (scReadCURunning() != 0) {
+        if (wallSeconds() - start > WAIT_LIMIT_SECONDS) {
+            printf("On test '%s', the S1 was still running after %d"
+                   " seconds\n", testname, WAIT_LIMIT_SECONDS);
+            exit(1);
+        }
+    }
+}
+
+void profileFinish () {
+    // Measures the profile marks the kernel sends after its last
+    // emitSignalCPU.  Call this before reading the report.
+    while (profiling && profileNextEvent < profileEventCount) {
+        waitProfileMark();
+    }
+}
+
+void profileReport (char *prefix) {
+    // Prints one CSV line per profiled region, after prefix, in the
+    // columns of the benchmark, with the instructions and ape words left
+    // empty:
+    //   <prefix>region,cycles,seconds,,
+    // The cycles are left empty too if no region took any, since then
+    // scTotalCyclesTaken did not move during the kernel.
+    int region;
+    int cyclesMoved = 0;
+    for (region = 0; region < profileRegionCount; region++) {
+        if (profileRegions[region].cycles != 0) cyclesMoved = 1;
+    }
+    for (region = 0; region < profileRegionCount; region++) {
+        ProfileRegion *r = &profileRegions[region];
+        printf("%s%s,", prefix, r->name);
+        if (cyclesMoved) printf("%ld", r->cycles);
+        printf(",%.6f,,\n", r->seconds);
+    }
+}
+
+void profileReset () {
+    // Forgets all profiled regions and signals, ready for a new kernel.
+    profileEventCount = 0;
+    profileNextEvent = 0;
+    profileRegionCount = 0;
+    profileEmitDepth = 0;
+    profileRunDepth = 0;
+}
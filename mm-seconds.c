@@ -0,0 +1,6 @@
+double wallSeconds () {
+    // Returns the current time in seconds, for timing.
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9*t.tv_nsec;
+}
@@ -1,3 +1,43 @@
+void allocateTiledMatrices (int m, int k, int p) {
+    // Sets the dimensions of the tiled multiply and allocates the CPU
+    // space for its matrices.
+    tiledM = m;
+    tiledK = k;
+    tiledP = p;
+    floatTA = malloc(sizeof(float)*m*k);
+    floatTB = malloc(sizeof(float)*k*p);
+    floatTC = malloc(sizeof(float)*m*p);
+
+    if (floatTA == NULL || floatTB == NULL || floatTC == NULL) {
+        printf("Out of memory allocating tiled matrices.\n");
+        exit(1);
+    }
+} // End allocateTiledMatrices.
+
+void freeTiledMatrices () {
+    // Frees the space allocateTiledMatrices allocated.
+    free(floatTA);
+    free(floatTB);
+    free(floatTC);
+    floatTA = floatTB = floatTC = NULL;
+} // End freeTiledMatrices.
+
+float streamB (int step, int i, int j) {
+    // Returns element [i][j] of B number step in the streaming test.
+    return 1 + (i + j*(step+1))%5;
+}
+
+float streamR (int i, int j) {
+    // Returns element [i][j] of the resident matrix in the streaming test.
+    return 1 + (i*j)%3;
+}
+
+float batchValue (int pair, int which, int i, int j) {
+    // Returns element [i][j] of matrix A (which is 0) or matrix B (which
+    // is 1) of the given pair in the batched multiply test.
+    return 1 + (i + 2*j + 3*pair + which)%4;
+}
+
 void tests () {
     int i,j;
 
@@ -16,30 +56,58 @@ void tests () {
     // Copy A from Apes to CU, send signal to CPU and wait for it to say
     // to continue.
     emitCopyMatrixFromApesToCU(MemAddress(A), 0 /* cuAddress */);
-    eCUC(cuSetSignal, _, _, _);
-    eCUC(cuWaitForClearSignal, _, _, _);
-
-    // In order to check whether emitMatrixMul multiplied correctly, we
-    // must calculate what results it should've given us.  We do this
-    // by calculating matrix A * matrix B.
-    float CorrectMultiply[N][N];
-    int k;
-    for(i=0; i<N; i++){
-        for(j=0; j<N; j++){
-            CorrectMultiply[i][j] = 0;
-            for(k=0; k<N; k++){
-                CorrectMultiply[i][j] += floatB[i][j] * floatA[k][j];
-            }
-        }
+    emitSignalCPU();
+
+    // Tiled multiply of matrices larger than the ape grid, with dimensions
+    // that are not multiples of N, so that C has 2x2 tiles, each the sum
+    // of 2 tile products.  The pair of tiles being multiplied, and the
+    // tile of C, go in CU Data Memory after the NxN matrix at address 0.
+    allocateTiledMatrices(N+4, 2*N, N+2);
+    int cuAddressTAB = N*N;
+    int cuAddressTC = cuAddressTAB + 2*N*N;
+
+    // C = A * B, tile by tile, with the CPU streaming in the tiles.  The
+    // tiles are copied with compact CUFor loops, and an unroll factor
+    // that does not divide the grid width, so those loops get tested too.
+    copyUnroll = 3;
+    emitTiledMatrixMul(tiledM, tiledK, tiledP, cuAddressTAB, cuAddressTC);
+    copyUnroll = 0;
+
+    // Stream several B matrices through a resident matrix, double
+    // buffering the Bs and the results in CU Data Memory after the tiles.
+    int streamCount = 4;
+    int cuAddressR = cuAddressTC + N*N;
+    int cuAddressSB[2] = { cuAddressR + N*N, cuAddressR + 2*N*N };
+    int cuAddressSC[2] = { cuAddressR + 3*N*N, cuAddressR + 4*N*N };
+    emitStreamMatrixMul(streamCount, cuAddressR, cuAddressSB[0], cuAddressSB[1],
+                        cuAddressSC[0], cuAddressSC[1]);
+
+    // Batched multiplies:  copy batchCount pairs of matrices from the CU
+    // to the apes, multiply every pair in one go, and copy each product
+    // back over its A in the CU.
+    int cuAddressBatch = cuAddressR + 5*N*N;
+    int pair;
+    for (pair=0; pair<batchCount; pair++) {
+        emitCopyMatrixFromCUToApes(cuAddressBatch + 2*pair*N*N,
+                                   MemAddress(batchA[pair]));
+        emitCopyMatrixFromCUToApes(cuAddressBatch + (2*pair+1)*N*N,
+                                   MemAddress(batchB[pair]));
     }
+    emitMatrixMulBatch(batchA, batchB, batchCount);
 
-    // Compares the correct matrix multiplication results against the
-    // results emitMatrixMul gave us.
-    for (i=0; i<N; i++) {
-        for (j=0; j<N; j++) {
-            check("Correct matrix multiplication", i, j, CorrectMultiply[i][j]);
-        }
+    // The same batch again, with the five ape variables per multiply of
+    // emitMatrixMulStart, which takes the most ape temporaries of any
+    // emitter.  So batchA[k] = batchA[k] * batchB[k] * batchB[k].
+    MatrixMulVars batchVars;
+    emitMatrixMulStart(&batchVars, batchA, batchB, batchCount);
+    emitMatrixMulSkew(&batchVars);
+    emitMatrixMulLoop(&batchVars);
+    emitMatrixMulEnd(&batchVars);
+    for (pair=0; pair<batchCount; pair++) {
+        emitCopyMatrixFromApesToCU(MemAddress(batchA[pair]),
+                                   cuAddressBatch + 2*pair*N*N);
     }
+    emitSignalCPU();
 
     // Emit Halt, waiting.
     eCUC(cuHalt, _, _, _);
@@ -47,6 +115,41 @@ void tests () {
     // Emit the low level translation of the high level kernel instructions.
     ellNewKernelInstructions();
 
+    // Generate B for the A = B * B test, and copy it to the CU.
+    for (i=0; i<N; i++) {
+        for (j=0; j<N; j++) {
+            floatB[i][j] = 1 + (i+j)%4;
+        }
+    }
+    copyBToCU(0);
+
+    // Generate the tiled matrices, keeping every element positive so
+    // that the relative error of the sums stays small.
+    for (i=0; i<tiledM; i++) {
+        for (j=0; j<tiledK; j++) {
+            floatTA[i*tiledK+j] = 1 + (i+j)%4;
+        }
+    }
+    for (i=0; i<tiledK; i++) {
+        for (j=0; j<tiledP; j++) {
+            floatTB[i*tiledP+j] = 1 + (i*j)%3;
+        }
+    }
+
+    // Generate the batch of matrix pairs and copy them to the CU, each
+    // A followed by its B.
+    int which;
+    for (pair=0; pair<batchCount; pair++) {
+        for (which=0; which<2; which++) {
+            for (i=0; i<N; i++) {
+                for (j=0; j<N; j++) {
+                    floatB[i][j] = batchValue(pair, which, i, j);
+                }
+            }
+            copyBToCU(cuAddressBatch + (2*pair+which)*N*N);
+        }
+    }
+
     // Load, free, and start low level kernel.
     scLLKernelLoad (llKernel, 0);
     scLLKernelFree(llKernel);
@@ -56,7 +159,356 @@ void tests () {
     scClearCUSignal();
 
     // Wait for S1 to complete A = A * B test, before allowing S1 to continue.
-    scLLKernelWaitSignal();
-    copyAFromCU();
+    // A started out equal to B, so A should now be B * B.
+    waitSignalCPU();
+    copyAFromCU(0);
+    checkMatrix("Correct matrix multiplication", &floatA[0][0],
+                &floatB[0][0], &floatB[0][0], N, N, N);
+
+    // Stream the tiles through the tiled C = A * B test, and compare C
+    // with the product computed on the CPU.
+    serveTiledMatrixMul(floatTA, floatTB, floatTC, tiledM, tiledK, tiledP,
+                        cuAddressTAB, cuAddressTC);
+    checkMatrix("Tiled matrix multiplication", floatTC, floatTA, floatTB,
+                tiledM, tiledK, tiledP);
+    freeTiledMatrices();
+
+    // Before letting the S1 start the stream, copy the resident matrix
+    // and the first B to the CU.
+    int step;
+    float resident[N][N];
+    float product[N][N];
+    for (i=0; i<N; i++) {
+        for (j=0; j<N; j++) {
+            floatB[i][j] = streamR(i, j);
+            resident[i][j] = streamR(i, j);
+        }
+    }
+    copyBToCU(cuAddressR);
+    memcpy(approxResident, approxM, sizeof(approxResident));
+    for (i=0; i<N; i++) {
+        for (j=0; j<N; j++) {
+            floatB[i][j] = streamB(0, i, j);
+        }
+    }
+    copyBToCU(cuAddressSB[0]);
+    scClearCUSignal();
+
+    // While the S1 multiplies by B number step, convert and copy B number
+    // step+1 into the other buffer.  Then wait for the S1 to finish step,
+    // let it go on to step+1 straight away, and check the result of step
+    // while it works.
+    for (step=0; step<streamCount; step++) {
+        if (step+1 < streamCount) {
+            for (i=0; i<N; i++) {
+                for (j=0; j<N; j++) {
+                    floatB[i][j] = streamB(step+1, i, j);
+                }
+            }
+            copyBToCU(cuAddressSB[(step+1)%2]);
+        }
+        waitSignalCPU();
+        scClearCUSignal();
+        copyAFromCU(cuAddressSC[step%2]);
+        for (i=0; i<N; i++) {
+            for (j=0; j<N; j++) {
+                product[i][j] = streamB(step, i, j);
+            }
+        }
+        checkMatrix("Streamed matrix multiplication", &floatA[0][0],
+                    &resident[0][0], &product[0][0], N, N, N);
+    }
+
+    // Wait for S1 to complete the batched multiplies, and check each
+    // product, A * B * B, against A * B from the CPU, times B.
+    waitSignalCPU();
+    float batchAB[N][N];
+    for (pair=0; pair<batchCount; pair++) {
+        copyAFromCU(cuAddressBatch + 2*pair*N*N);
+        for (i=0; i<N; i++) {
+            for (j=0; j<N; j++) {
+                resident[i][j] = batchValue(pair, 0, i, j);
+                product[i][j] = batchValue(pair, 1, i, j);
+            }
+        }
+        hostMatrixMul(&resident[0][0], &product[0][0], &batchAB[0][0],
+                      N, N, N);
+        checkMatrix("Batched matrix multiplication", &floatA[0][0],
+                    &batchAB[0][0], &product[0][0], N, N, N);
+    }
+    scClearCUSignal();
+
+    // Let the kernel halt, and start a new one.
+    waitHalt("Batched matrix multiplication");
+    scEmitLLKernelCreate();
+    eCUC(cuSetMaskMode, _, _, 1);
+
+    // Change two rows of the resident matrix, which is still in the apes
+    // from the stream, and copy just those rows to the CU.  The apes copy
+    // them in from the list the CPU leaves in CU memory.  Then multiply by
+    // the last B of the stream, which is still in its buffer.
+    for (i=0; i<N; i++) {
+        for (j=0; j<N; j++) {
+            resident[i][j] = streamR(i, j);
+        }
+    }
+    for (j=0; j<N; j++) {
+        resident[1][j] = 4;
+        resident[N-2][j] = 1 + j%2;
+    }
+    checkInt("Dirty row count",
+             copyDirtyRowsToCU(&resident[0][0], approxResident, cuAddressR),
+             2);
+    emitCopyDirtyRowsFromCUToApes(cuAddressR, MemAddress(Aresident));
+    emitCopyMatrixFromCUToApes(cuAddressSB[(streamCount-1)%2],
+                               MemAddress(B));
+    Set(A, Aresident);
+    emitMatrixMul();
+    emitCopyMatrixFromApesToCU(MemAddress(A), cuAddressSC[0]);
+    emitSignalCPU();
+
+    // The same copy again, after the CPU has put row N-2 back while the
+    // S1 waited.  This time it must copy just that row.
+    emitCopyDirtyRowsFromCUToApes(cuAddressR, MemAddress(Aresident));
+    Set(A, Aresident);
+    emitMatrixMul();
+    emitCopyMatrixFromApesToCU(MemAddress(A), cuAddressSC[0]);
+    emitSignalCPU();
+
+    // Once more, with no new list from the CPU, into an A of zeros.  The
+    // list must still be there, so this copies just row N-2 again.
+    Set(A, a0);
+    emitCopyDirtyRowsFromCUToApes(cuAddressR, MemAddress(A));
+    emitMatrixMul();
+    emitCopyMatrixFromApesToCU(MemAddress(A), cuAddressSC[0]);
+    emitSignalCPU();
+
+    // The same multiply with the torus shifts overlapped with the
+    // arithmetic, which is off by default.
+    pipelineCannonLoop = 1;
+    Set(A, Aresident);
+    emitMatrixMul();
+    pipelineCannonLoop = 0;
+    emitCopyMatrixFromApesToCU(MemAddress(A), cuAddressSC[0]);
+    emitSignalCPU();
+
+    // A = R * B * B, with the lean multiply first.  It must put B back
+    // for the second multiply to be right.
+    Set(A, Aresident);
+    emitMatrixMulLean(&A, &B, 1, 1);
+    emitMatrixMul();
+    emitCopyMatrixFromApesToCU(MemAddress(A), cuAddressSC[0]);
+    emitSignalCPU();
+
+    // y = R * x, with the updated resident matrix.  x and y go in the
+    // other result buffer.
+    int cuAddressX = cuAddressSC[1];
+    int cuAddressY = cuAddressSC[1] + N;
+    emitMatrixVectorMul(Aresident, cuAddressX, cuAddressY);
+    emitSignalCPU();
+
+    // The sum, minimum, maximum and argmax of the resident matrix, each
+    // read back as a single word (three for the argmax), after y.
+    int cuAddressReduce = cuAddressY + N;
+    emitReduceToCU(Aresident, reduceSum, cuAddressReduce);
+    emitReduceToCU(Aresident, reduceMin, cuAddressReduce+1);
+    emitReduceToCU(Aresident, reduceArgMax, cuAddressReduce+2);
+    emitSignalCPU();
+
+    // C = P^7 for the permutation matrix P that moves each row up one,
+    // in the apes, from the first stream buffer.  7 is 111 in binary, so
+    // this runs a CUFor around a squaring and a multiply.  Every product
+    // and sum is of 0s and 1s, so the result is exact.
+    // The multiplies above have already made all the temporaries a
+    // multiply needs, so the power takes only its copy of P.
+    int power = 7;
+    int apeTemps = apePoolCount;
+    emitCopyMatrixFromCUToApes(cuAddressSB[0], MemAddress(B));
+    emitMatrixPower(B, C, power);
+    checkInt("Ape temporaries made by emitMatrixPower",
+             apePoolCount - apeTemps, 0);
+    checkInt("Ape temporaries in use", apePoolInUse, 0);
+    emitCopyMatrixFromApesToCU(MemAddress(C), cuAddressSC[0]);
+    emitSignalCPU();
+
+    // C = B^2 for the last B of the stream, which is still in its buffer.
+    // Unlike P, squaring this B adds up many different products, so it
+    // shows whether the squaring kept its two operands apart.
+    emitCopyMatrixFromCUToApes(cuAddressSB[(streamCount-1)%2],
+                               MemAddress(B));
+    emitMatrixPower(B, C, 2);
+    emitCopyMatrixFromApesToCU(MemAddress(C), cuAddressSC[0]);
+    emitSignalCPU();
+
+    eCUC(cuHalt, _, _, _);
+    ellNewKernelInstructions();
+    float x[N];
+    float y[N];
+    for (j=0; j<N; j++) {
+        x[j] = 1 + j%3;
+    }
+    cvtApproxArray((scApprox *)approxM, x, N);
+    scWriteCUDataMemoryBlock(2*N, (uintptr_t)approxM, cuAddressX);
+    for (i=0; i<N; i++) {
+        for (j=0; j<N; j++) {
+            floatB[i][j] = (j == (i+1)%N);
+        }
+    }
+    copyBToCU(cuAddressSB[0]);
+    scLLKernelLoad (llKernel, 0);
+    scLLKernelFree(llKernel);
+    scLLKernelExecute(0);
+    scClearCUSignal();
+
+    // Wait for S1 to multiply the updated resident matrix, and check it.
+    waitSignalCPU();
+    copyAFromCU(cuAddressSC[0]);
+    for (i=0; i<N; i++) {
+        for (j=0; j<N; j++) {
+            product[i][j] = streamB(streamCount-1, i, j);
+        }
+    }
+    checkMatrix("Dirty row update", &floatA[0][0], &resident[0][0],
+                &product[0][0], N, N, N);
+    for (j=0; j<N; j++) {
+        resident[N-2][j] = streamR(N-2, j);
+    }
+    checkInt("Dirty row count",
+             copyDirtyRowsToCU(&resident[0][0], approxResident, cuAddressR),
+             1);
+    scClearCUSignal();
+
+    // Wait for S1 to copy in row N-2 and multiply again, and check it.
+    waitSignalCPU();
+    copyAFromCU(cuAddressSC[0]);
+    checkMatrix("Dirty row update", &floatA[0][0], &resident[0][0],
+                &product[0][0], N, N, N);
+    scClearCUSignal();
+
+    // Wait for S1 to copy row N-2 again, alone, and multiply, and check it.
+    waitSignalCPU();
+    copyAFromCU(cuAddressSC[0]);
+    float dirtyOnly[N][N];
+    for (i=0; i<N; i++) {
+        for (j=0; j<N; j++) {
+            dirtyOnly[i][j] = i == N-2 ? resident[i][j] : 0;
+        }
+    }
+    checkMatrix("Dirty row rerun", &floatA[0][0], &dirtyOnly[0][0],
+                &product[0][0], N, N, N);
+    scClearCUSignal();
+
+    // Wait for S1 to multiply with the pipelined loop, and check it.
+    waitSignalCPU();
+    copyAFromCU(cuAddressSC[0]);
+    checkMatrix("Pipelined matrix multiplication", &floatA[0][0],
+                &resident[0][0], &product[0][0], N, N, N);
+    scClearCUSignal();
+
+    // Wait for S1 to multiply by B twice, and check it against R * B from
+    // the CPU, times B.
+    waitSignalCPU();
+    copyAFromCU(cuAddressSC[0]);
+    float residentB[N][N];
+    hostMatrixMul(&resident[0][0], &product[0][0], &residentB[0][0],
+                  N, N, N);
+    checkMatrix("Lean matrix multiplication", &floatA[0][0],
+                &residentB[0][0], &product[0][0], N, N, N);
+    scClearCUSignal();
+
+    // Wait for S1 to complete y = R * x, and check y as an N x 1 matrix.
+    waitSignalCPU();
+    scReadCUDataMemoryBlock(2*N, (uintptr_t)approxM, cuAddressY);
+    cvtFloatArray(y, (scApprox *)approxM, N);
+    checkMatrix("Matrix vector multiplication", y, &resident[0][0], x,
+                N, N, 1);
+    scClearCUSignal();
+
+    // Wait for S1 to complete the reductions, and check them against the
+    // resident matrix.  The maximum, 4, is first found in row 1.
+    waitSignalCPU();
+    float sum = 0;
+    float smallest = resident[0][0];
+    for (i=0; i<N; i++) {
+        for (j=0; j<N; j++) {
+            sum += resident[i][j];
+            if (resident[i][j] < smallest) smallest = resident[i][j];
+        }
+    }
+    int16_t words[8];
+    scReadCUDataMemoryBlock(2*8, (uintptr_t)approxM, cuAddressReduce);
+    memcpy(words, approxM, sizeof(words));
+    cvtFloatArray(y, (scApprox *)approxM, 3);
+    checkValue("Grid sum", 0, 0, y[0], sum);
+    checkValue("Grid min", 0, 0, y[1], smallest);
+    checkValue("Grid max", 0, 0, y[2], 4);
+    checkInt("Grid argmax row", words[3], 1);
+    checkInt("Grid argmax column", words[4], 0);
+    scClearCUSignal();
+
+    // Wait for S1 to complete C = P^7.  P^7 moves each row up 7, so
+    // element [i][j] is 1 where j is i+7 (mod N), and 0 elsewhere.
+    waitSignalCPU();
+    copyAFromCU(cuAddressSC[0]);
+    for (i=0; i<N; i++) {
+        for (j=0; j<N; j++) {
+            check("Matrix power", i, j, j == (i+power)%N);
+        }
+    }
+    scClearCUSignal();
+
+    // Wait for S1 to complete C = B^2, and check it.  product still holds
+    // the last B of the stream.
+    waitSignalCPU();
+    copyAFromCU(cuAddressSC[0]);
+    checkMatrix("Matrix square", &floatA[0][0], &product[0][0],
+                &product[0][0], N, N, N);
     scClearCUSignal();
+
+    // A kernel that posts results to the mailbox:  result n is P^(n+1),
+    // in buffer n % MAILBOX_SLOTS, which reuses the batch buffers.  There
+    // are more results than slots, so the S1 fills the ring and waits for
+    // the CPU once.  The CPU submits the kernel without waiting for the
+    // one before to halt, and polls for results as they come.
+    int resultCount = MAILBOX_SLOTS + 2;
+    int cuAddressMailbox = cuAddressReduce + 8;
+    mailboxInit(cuAddressMailbox);
+    eCUC(cuSetMaskMode, _, _, 1);
+    emitCopyMatrixFromCUToApes(cuAddressSB[0], MemAddress(B));
+    Set(C, B);
+    int result;
+    for (result=0; result<resultCount; result++) {
+        if (result > 0) emitMatrixMulOnce(C, B);
+        emitCopyMatrixFromApesToCU(MemAddress(C), cuAddressBatch +
+                                   (result%MAILBOX_SLOTS)*N*N);
+        emitMailboxPost();
+    }
+    kernelSubmit();
+
+    // Polling assumes the S1 (or the emulator) runs while the CPU polls,
+    // which has not been checked on the emulator, so the wait is limited.
+    int taken = 0;
+    double start = wallSeconds();
+    while (taken < resultCount) {
+        kernelPoll();
+        result = mailboxPoll();
+        if (result < 0) {
+            if (wallSeconds() - start > WAIT_LIMIT_SECONDS) {
+                printf("On test 'Mailbox result', only %d of %d results"
+                       " after %d seconds\n", taken, resultCount,
+                       WAIT_LIMIT_SECONDS);
+                exit(1);
+            }
+            continue;
+        }
+        copyAFromCU(cuAddressBatch + (result%MAILBOX_SLOTS)*N*N);
+        for (i=0; i<N; i++) {
+            for (j=0; j<N; j++) {
+                check("Mailbox result", i, j, j == (i+result+1)%N);
+            }
+        }
+        if (mailboxDone()) mailboxRelease();
+        taken++;
+    }
+    waitHalt("Mailbox result");
 } // End tests().
@@ -22,6 +22,7 @@
    A = b/A (scalar)
    A += B
    A *= B
+   A = f(alpha * A * B + beta * C), with f an optional element-wise function
 
    For this code, A and B have fixed, identical, square NxN shapes, where N=8.
    Matrix elements are stored one per core.
@@ -67,9 +68,10 @@ uint64_t approxM[(N*N)/4];
 Declare(a0);
 Declare(a1);
 
-// Declare names of A and B matrices in Ape memory.
+// Declare names of A, B and C matrices in Ape memory.
 Declare(A);
 Declare(B);
+Declare(C);
 
 // Initialization routine to define the names above
 void defineNames () {
@@ -77,6 +79,38 @@ void defineNames () {
     a1 = AConst(1);
     ApeMem(A, Approx);
     ApeMem(B, Approx);
+    ApeMem(C, Approx);
+}
+
+
+// The element-wise operations (emitScalarSet and so on) don't store A
+// straight away.  They build up A's new value as one Nova expression,
+// pendingA, and emitFlushA stores it with a single Set, so a chain of them
+// loads and stores A once instead of once per operation.  Anything that
+// reads A, or writes B, in ape memory must call emitFlushA first, and so
+// must the end of the kernel.  Each operation adds one node on top of the
+// expression before it, so however long the chain, the apes only need to
+// hold the running value and one operand at a time.
+scExpr pendingA;
+int pendingOps = 0;     // 0 if A is up to date
+
+scExpr currentA () {
+    // the value of A, including any operations not yet stored
+    return pendingOps > 0 ? pendingA : A;
+}
+
+void emitFlushA () {
+    // emit code to store any pending operations in A
+    if (pendingOps > 0) {
+        Set(A, pendingA);
+        pendingOps = 0;
+    }
+}
+
+void deferA (scExpr x) {
+    // make x the new value of A, to be stored by emitFlushA
+    pendingA = x;
+    pendingOps++;
 }
 
 
@@ -85,6 +119,9 @@ void emitCopyMatrixFromCUToApes(int cuAddress, int apeAddress) {
     // from CU Data Memory starting at cuAddress 
     // to the Ape grid, in Ape[0..N-1, 0..N-1]Mem[apeAddress].
 
+    // pending operations on A may use the old B
+    emitFlushA();
+
     eCUC(cuSet, cuRChipRow, _, 0);
     eCUC(cuSet, cuRChipCol, _, 0);
     int col;
@@ -103,6 +140,9 @@ void emitCopyMatrixFromApesToCU(int apeAddress, int cuAddress) {
     // to CU Data Memory starting at cuAddress.
     // This code destroys cuR11 and apeR0.
 
+    // A may be the matrix being read
+    emitFlushA();
+
     // Reserve apeR0 register for A matrix
     eControl(controlOpReserveApeReg,apeR0);
 
@@ -165,6 +205,8 @@ void emitPrintARowCol (int row, int col) {
     // This only works when running in the Emulator.  The real S1 ignores these operations.
     // Note: This code leaves MaskMode turned on.
 
+    emitFlushA();
+
     // Note: We need to turn off Mask Mode in order to make the loads work
     eCUC(cuSetMaskMode, _, _, 0);
 
@@ -181,27 +223,29 @@ void emitPrintARowCol (int row, int col) {
 }
 
 void emitScalarSet (float f) {
-    Set(A, AConst(f));
+    pendingOps = 0;
+    deferA(AConst(f));
 }
 
 void emitScalarAdd (float f) {
-    Set(A, Add(A, AConst(f)));
+    deferA(Add(currentA(), AConst(f)));
 }
 
 void emitScalarMul (float f) {
-    Set(A, Mul(A, AConst(f)));
+    deferA(Mul(currentA(), AConst(f)));
 }
 
 void emitScalarReciprocal (float f) {
-    Set(A, Div(AConst(f), A));
+    deferA(Div(AConst(f), currentA()));
 }
 
 void emitMatrixSet () {
-    Set(A, B);
+    pendingOps = 0;
+    deferA(B);
 }
 
 void emitMatrixAdd () {
-    Set(A, Add(A, B));
+    deferA(Add(currentA(), B));
 }
 
 // used getApe before, but that isn't set
@@ -217,10 +261,42 @@ void emitGetTorus(scExpr x, int dir){
     eApeC(apeGetGEnd, x, x, dir);
 }
 
-void emitMatrixMul () {
-    // emit code for matrix multiply:  A = A + B
+// Element-wise functions emitGemm can apply to its result
+enum { epilogueNone, epilogueRelu, epilogueClamp, epilogueReciprocal };
+
+void emitEpilogue (scExpr x, int epilogue, float lo, float hi) {
+    // emit code for x = f(x), where f is given by epilogue:
+    //   epilogueNone        x
+    //   epilogueRelu        max(x, 0)
+    //   epilogueClamp       x limited to lo..hi
+    //   epilogueReciprocal  1/x
+    // Relu and clamp need mask mode on.
+    if (epilogue == epilogueRelu) {
+        ApeIf(Gt(a0, x));
+             Set(x, a0);
+        ApeFi();
+    } else if (epilogue == epilogueClamp) {
+        ApeIf(Gt(AConst(lo), x));
+             Set(x, AConst(lo));
+        ApeFi();
+        ApeIf(Gt(x, AConst(hi)));
+             Set(x, AConst(hi));
+        ApeFi();
+    } else if (epilogue == epilogueReciprocal) {
+        Set(x, Div(a1, x));
+    }
+}
+
+void emitGemm (float alpha, float beta, int epilogue, float lo, float hi) {
+    // emit code for A = f(alpha * A * B + beta * C), with f given by
+    // epilogue, lo and hi as in emitEpilogue.
+    // The scaling, C and f are all applied to the running total in the
+    // last step of the multiply, so A is written once, rather than once
+    // for each of emitMatrixMul, emitScalarMul, emitMatrixAdd and so on.
     // See Cypher and Sanz 5.6 for a description of this algorithm
     int i;
+    emitFlushA();
+
     // create variables in each ape for the apes row and column numbers
     // set them to zero initially
     DeclareApeVar(row, Int);
@@ -297,7 +373,7 @@ void emitMatrixMul () {
     DeclareApeVar(runningTotal, Approx);
     Set(runningTotal,ApproxConst(0));
     i = 0;
-    do{
+    while (i < N-1) {
         // should start off shifted and zeroed, so:
         //TraceMessage("runningTotal, Aloaded, Bloaded:\n");
         //TraceOneRegisterOneApe(runningTotal, 3, 5);
@@ -309,12 +385,26 @@ void emitMatrixMul () {
         emitGetTorus(Aloaded, getEast);
         emitGetTorus(Bloaded, getSouth);
         i++;
-    }while(i < N);
+    }
+
+    // last step: add the last product, and apply alpha, beta * C and f
+    // while the total is still in an ape variable.  There's no need to
+    // shift Aloaded and Bloaded again afterwards.
+    scExpr total = Add(runningTotal, Mul(Aloaded, Bloaded));
+    if (alpha != 1) total = Mul(AConst(alpha), total);
+    if (beta != 0) total = Add(total, Mul(AConst(beta), C));
+    Set(runningTotal, total);
+    emitEpilogue(runningTotal, epilogue, lo, hi);
 
     Set(B, Bsaved);
     Set(A, runningTotal);
 }
 
+void emitMatrixMul () {
+    // emit code for matrix multiply:  A = A * B
+    emitGemm(1, 0, epilogueNone, 0, 0);
+}
+
 
 void check (char *testname, int i, int j, float expected) {
     // Print an error if floatA[i][j] is not close to expected.
@@ -382,6 +472,36 @@ void tests () {
     eCUC(cuSetSignal, _, _, _);
     eCUC(cuWaitForClearSignal, _, _, _);
 
+    // C = B, A = B, A = .5 * A * B + 2 * C
+    Set(C, B);
+    emitMatrixSet();
+    emitGemm(.5, 2, epilogueNone, 0, 0);
+
+    // copy A from Apes to CU, send signal to CPU and wait for it to say to continue
+    emitCopyMatrixFromApesToCU(MemAddress(A), 0 /* cuAddress */);
+    eCUC(cuSetSignal, _, _, _);
+    eCUC(cuWaitForClearSignal, _, _, _);
+
+    // A = B, A = relu(.5 * A * B - 100 * C)
+    emitMatrixSet();
+    emitGemm(.5, -100, epilogueRelu, 0, 0);
+
+    // copy A from Apes to CU, send signal to CPU and wait for it to say to continue
+    emitCopyMatrixFromApesToCU(MemAddress(A), 0 /* cuAddress */);
+    eCUC(cuSetSignal, _, _, _);
+    eCUC(cuWaitForClearSignal, _, _, _);
+
+    // A = B, A += 1, A *= 2, A = 4/A, all stored with one Set
+    emitMatrixSet();
+    emitScalarAdd(1);
+    emitScalarMul(2);
+    emitScalarReciprocal(4);
+
+    // copy A from Apes to CU, send signal to CPU and wait for it to say to continue
+    emitCopyMatrixFromApesToCU(MemAddress(A), 0 /* cuAddress */);
+    eCUC(cuSetSignal, _, _, _);
+    eCUC(cuWaitForClearSignal, _, _, _);
+
     // check matrix A is what we want, compare to correct answers
     float CorrectMultiply[N][N];
     int k;
@@ -400,7 +520,8 @@ void tests () {
     }
 
 
-    // emit Halt
+    // store any pending operations on A, then emit Halt
+    emitFlushA();
     eCUC(cuHalt, _, _, _);
 
     // emit the low level translation of the high level kernel instructions
@@ -484,6 +605,50 @@ void tests () {
     // check
     scClearCUSignal();
 
+    // Wait for S1 to complete A = .5 * B * B + 2 * B test
+    // allow S1 to continue
+    float BB[N][N];
+    for (i=0; i<N; i++) {
+        for (j=0; j<N; j++) {
+            BB[i][j] = 0;
+            for (k=0; k<N; k++) {
+                BB[i][j] += floatB[i][k] * floatB[k][j];
+            }
+        }
+    }
+    scLLKernelWaitSignal();
+    copyAFromCU();
+    for (i=0; i<N; i++) {
+        for (j=0; j<N; j++) {
+            check("A=.5*A*B+2*C", i, j, .5*BB[i][j] + 2*floatB[i][j]);
+        }
+    }
+    scClearCUSignal();
+
+    // Wait for S1 to complete A = relu(.5 * B * B - 100 * B) test
+    // only A[0][0] is positive, everything else is clamped to exactly 0
+    scLLKernelWaitSignal();
+    copyAFromCU();
+    for (i=0; i<N; i++) {
+        for (j=0; j<N; j++) {
+            float expected = .5*BB[i][j] - 100*floatB[i][j];
+            check("A=relu(.5*A*B-100*C)", i, j, expected > 0 ? expected : 0);
+        }
+    }
+    scClearCUSignal();
+
+    // Wait for S1 to complete A = 4/((B+1)*2) test
+    // check if A[i,j] ~ 2/(i+j+1)
+    // allow S1 to continue
+    scLLKernelWaitSignal();
+    copyAFromCU();
+    for (i=0; i<N; i++) {
+        for (j=0; j<N; j++) {
+            check("A=4/((B+1)*2)", i, j, 2./(i+j+1));
+        }
+    }
+    scClearCUSignal();
+
 
 }
 